@@ -0,0 +1,300 @@
+// Headless benchmark of the image operations used by the GUI, on synthetic arenas of 1, 4 and 12 MP.
+// Usage: pogotrack_bench [--reps N] [--json results.json] [--baseline baseline.json] [--tolerance 1.3]
+// With a baseline, exits with 1 when an operation is slower than tolerance x its baseline time.
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../src/Kernels.h"
+#include "../src/MaskRuns.h"
+#include "../src/Histogram.h"
+#include "../src/RegionStats.h"
+#include "../src/Filters.h"
+#include "../src/Background.h"
+#include "../src/Components.h"
+#include "../src/ComponentTree.h"
+#include "../src/Detection.h"
+#include "../src/ImageConvert.h"
+#include "../src/Tracker.h"
+#include "../src/ResultCache.h"
+
+// Deterministic synthetic arena: dark floor, soft glare and bright robots
+static cv::Mat syntheticArena(cv::Size size, int robots = 200)
+{
+    cv::RNG rng(0x9060);
+    cv::Mat img(size, CV_8UC3, cv::Scalar(25, 30, 28));
+    cv::circle(img, cv::Point(size.width / 3, size.height / 3), size.height / 4,
+               cv::Scalar(70, 70, 70), -1, cv::LINE_AA);
+    cv::GaussianBlur(img, img, cv::Size(0, 0), size.height / 16.0);
+    for (int i = 0; i < robots; i++) {
+        cv::Point c(rng.uniform(60, size.width - 60), rng.uniform(60, size.height - 60));
+        int r = rng.uniform(40, 60);
+        cv::circle(img, c, r, cv::Scalar(rng.uniform(120, 255), rng.uniform(120, 255), rng.uniform(120, 255)), -1, cv::LINE_AA);
+    }
+    cv::Mat noise(size, CV_8UC3);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 12);
+    img += noise;
+    return img;
+}
+
+// Median time of `reps` runs, in milliseconds
+static double timeIt(int reps, const std::function<void()> &fn)
+{
+    std::vector<double> times;
+    fn(); // warm up
+    for (int i = 0; i < reps; i++) {
+        cv::TickMeter tm;
+        tm.start();
+        fn();
+        tm.stop();
+        times.push_back(tm.getTimeMilli());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// Former MainWindow path: split, two max, threshold, masked copy
+static void referenceThreshold(const cv::Mat &bgr, double thresh, const cv::Mat &mask, cv::Mat &dst)
+{
+    cv::Mat ch[3];
+    cv::split(bgr, ch);
+    cv::Mat maxGray;
+    cv::max(ch[0], ch[1], maxGray);
+    cv::max(maxGray, ch[2], maxGray);
+    cv::Mat binary;
+    cv::threshold(maxGray, binary, thresh, 255, cv::THRESH_BINARY);
+    cv::Mat masked;
+    binary.copyTo(masked, mask);
+    dst = masked;
+}
+
+struct Result {
+    std::string name;
+    std::string size;
+    double ms;
+};
+
+static bool writeJson(const std::string &path, int reps, const std::vector<Result> &results)
+{
+    cv::FileStorage file(path, cv::FileStorage::WRITE | cv::FileStorage::FORMAT_JSON);
+    if (!file.isOpened()) return false;
+    file << "repetitions" << reps;
+    file << "threads" << cv::getNumThreads();
+    file << "results" << "[";
+    for (const Result &r : results)
+        file << "{" << "name" << r.name << "size" << r.size << "ms" << r.ms << "}";
+    file << "]";
+    return true;
+}
+
+static bool readJson(const std::string &path, std::vector<Result> &results)
+{
+    cv::FileStorage file;
+    try {
+        if (!file.open(path, cv::FileStorage::READ)) return false;
+    } catch (const cv::Exception &) {
+        return false;
+    }
+    for (const cv::FileNode &node : file["results"])
+        results.push_back({(std::string)node["name"], (std::string)node["size"], (double)node["ms"]});
+    return true;
+}
+
+// Number of operations slower than tolerance x baseline. Differences under
+// half a millisecond are timer noise on the small operations and never count.
+static int compareBaseline(const std::vector<Result> &results, const std::vector<Result> &baseline, double tolerance)
+{
+    int regressions = 0;
+    for (const Result &r : results) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const Result &b) {
+            return b.name == r.name && b.size == r.size;
+        });
+        if (it == baseline.end()) {
+            std::printf("%-28s %10s not in baseline\n", r.name.c_str(), r.size.c_str());
+            continue;
+        }
+        if (r.ms > it->ms * tolerance && r.ms - it->ms > 0.5) {
+            std::printf("%-28s %10s REGRESSION %.3f ms vs %.3f ms baseline\n",
+                        r.name.c_str(), r.size.c_str(), r.ms, it->ms);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    int reps = 20;
+    double tolerance = 1.3;
+    std::string jsonPath, baselinePath;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--reps") == 0 && hasValue) reps = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--json") == 0 && hasValue) jsonPath = argv[++i];
+        else if (std::strcmp(argv[i], "--baseline") == 0 && hasValue) baselinePath = argv[++i];
+        else if (std::strcmp(argv[i], "--tolerance") == 0 && hasValue) tolerance = std::atof(argv[++i]);
+        else if (argv[i][0] != '-') reps = std::atoi(argv[i]);  // former usage: pogotrack_bench [repetitions]
+        else {
+            std::fprintf(stderr, "Usage: pogotrack_bench [--reps N] [--json results.json] "
+                                 "[--baseline baseline.json] [--tolerance 1.3]\n");
+            return 2;
+        }
+    }
+    if (reps < 1) reps = 1;
+
+    // 1, 4 and 12 MP
+    const cv::Size sizes[] = {cv::Size(1280, 800), cv::Size(2560, 1600), cv::Size(4000, 3000)};
+    const double thresh = 100;
+    const int blockSizes[] = {11, 51, 151};
+    const HoughParams hough = {1.0, 20.0, 10.0, 14.0, 40, 60};
+
+    std::vector<Result> results;
+    std::printf("%-28s %10s %12s\n", "operation", "size", "median ms");
+    for (const cv::Size &size : sizes) {
+        char dims[32];
+        std::snprintf(dims, sizeof(dims), "%dx%d", size.width, size.height);
+        auto run = [&](const std::string &name, const std::function<void()> &fn) {
+            double ms = timeIt(reps, fn);
+            results.push_back({name, dims, ms});
+            std::printf("%-28s %10s %12.3f\n", name.c_str(), dims, ms);
+        };
+
+        cv::Mat img = syntheticArena(size);
+        cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+        cv::circle(mask, cv::Point(size.width / 2, size.height / 2), size.height * 2 / 5, cv::Scalar(255), -1);
+
+        cv::Mat ref, fused;
+        referenceThreshold(img, thresh, mask, ref);
+        maxChannelThresholdMasked(img, thresh, mask, fused);
+        if (cv::norm(ref, fused, cv::NORM_INF) != 0) {
+            std::fprintf(stderr, "fused kernel differs from reference at %s\n", dims);
+            return 1;
+        }
+        // A small region of interest, where the run-length path should pay off most
+        cv::Mat roi = cv::Mat::zeros(size, CV_8UC1);
+        cv::circle(roi, cv::Point(size.width / 4, size.height / 4), size.height / 10, cv::Scalar(255), -1);
+        MaskRuns runs = MaskRuns::fromMask(mask);
+        MaskRuns roiRuns = MaskRuns::fromMask(roi);
+        cv::Mat fromRuns;
+        maxChannelThresholdRuns(img, thresh, runs, fromRuns);
+        if (cv::norm(ref, fromRuns, cv::NORM_INF) != 0) {
+            std::fprintf(stderr, "runs kernel differs from reference at %s\n", dims);
+            return 1;
+        }
+
+        cv::Mat gray, binary;
+        maxChannelGray(img, gray);
+        binary = fused;
+
+        run("max channel gray", [&]() { cv::Mat out; maxChannelGray(img, out); });
+        run("threshold (reference)", [&]() { cv::Mat out; referenceThreshold(img, thresh, mask, out); });
+        run("threshold (fused)", [&]() { cv::Mat out; maxChannelThresholdMasked(img, thresh, mask, out); });
+        for (int blockSize : blockSizes) {
+            AdaptiveThresholdFilter adaptive;
+            adaptive.setParams({MEAN_C, blockSize, -10.0});
+            run("adaptive threshold " + std::to_string(blockSize), [&]() { adaptive.apply(gray); });
+        }
+        run("threshold (runs)", [&]() { cv::Mat out; maxChannelThresholdRuns(img, thresh, runs, out); });
+        run("threshold small roi (fused)", [&]() { cv::Mat out; maxChannelThresholdMasked(img, thresh, roi, out); });
+        run("threshold small roi (runs)", [&]() { cv::Mat out; maxChannelThresholdRuns(img, thresh, roiRuns, out); });
+        run("mask to runs", [&]() { MaskRuns::fromMask(mask); });
+        run("apply mask", [&]() { cv::Mat out; img.copyTo(out, mask); });
+        run("apply mask (runs)", [&]() { cv::Mat out; copyRuns(img, runs, out); });
+        run("histogram (masked)", [&]() { computeHistogram(gray, mask); });
+        run("histogram (runs)", [&]() { computeHistogram(gray, runs); });
+        RegionStatsIndex regionStats;
+        run("region stats build", [&]() { regionStats.build(img); });
+        const cv::Rect half(size.width / 4, size.height / 4, size.width / 2, size.height / 2);
+        run("region stats rect", [&]() { regionStats.rect(half); });
+        run("region stats circle", [&]() { regionStats.circle(cv::Point(size.width / 2, size.height / 2), size.height / 4); });
+        BackgroundModel median, mean;
+        mean.setMode(BackgroundModel::EXPONENTIAL_MEAN);
+        median.update(img);
+        mean.update(img);
+        run("background update median", [&]() { median.update(img); });
+        run("background update mean", [&]() { mean.update(img); });
+        cv::Mat background = median.background();
+        run("subtract background", [&]() { subtractBackground(img, background); });
+        run("connected components", [&]() { labelComponents(binary, cv::CCL_SPAGHETTI, true); });
+        // Threshold slider with live components: one tree per image, then a node scan per
+        // threshold instead of a labeling
+        cv::Mat maskedGray;
+        copyRuns(gray, runs, maskedGray);
+        ComponentTree tree;
+        run("component tree build", [&]() { tree.build(maskedGray); });
+        run("component tree counts", [&]() { tree.counts(); });
+        cv::Mat treeStats, treeCentroids;
+        run("component tree threshold", [&]() { tree.components(int(thresh), treeStats, treeCentroids); });
+        cv::Mat labels;
+        if (tree.components(int(thresh), treeStats, treeCentroids) != cv::connectedComponents(binary, labels, 8)) {
+            std::fprintf(stderr, "component tree count differs from labeling at %s\n", dims);
+            return 1;
+        }
+        run("hough circles", [&]() { houghCirclesTiled(binary, hough, mask); });
+        // Detector backends on the same robots, untiled OpenCV calls for reference.
+        // Annulus votes are edge pixels, a robot ring holds about 2 pi r of them.
+        HoughParams annulus = hough;
+        annulus.param2 = 120;
+        std::vector<cv::Vec3f> gradient, alt;
+        run("hough gradient (opencv)", [&]() {
+            cv::HoughCircles(binary, gradient, cv::HOUGH_GRADIENT, hough.dp, hough.minDist,
+                             hough.param1, hough.param2, hough.minRadius, hough.maxRadius);
+        });
+        run("hough gradient alt (opencv)", [&]() {
+            cv::HoughCircles(binary, alt, cv::HOUGH_GRADIENT_ALT, 1.5, hough.minDist,
+                             300, 0.8, hough.minRadius, hough.maxRadius);
+        });
+        run("annulus circles", [&]() { annulusCircles(binary, annulus, mask); });
+        run("blob circles", [&]() { blobCircles(binary, hough, mask); });
+        std::printf("%-28s %10s gradient %zu, alt %zu, annulus %zu, blobs %zu\n", "  circles found", dims,
+                    gradient.size(), alt.size(), annulusCircles(binary, annulus, mask).size(),
+                    blobCircles(binary, hough, mask).size());
+        // What a result cache lookup costs before it can skip the detection
+        run("cache key", [&]() { CacheKey("bench").add(gray).add(mask).add(hough, HOUGH_GRADIENT_DETECTOR).value(); });
+
+        ComponentsResult cc = labelComponents(binary, cv::CCL_SPAGHETTI, false);
+        run("matToQImage bgr", [&]() { matToQImage(img); });
+        run("matToQImage label map", [&]() { matToQImage(cc.labels); });
+    }
+
+    // Association only, robots drifting a few pixels per frame
+    for (int robots : {200, 1000}) {
+        cv::RNG rng(robots);
+        std::vector<cv::Point2f> positions(robots);
+        for (cv::Point2f &p : positions)
+            p = cv::Point2f(rng.uniform(0.f, 4000.f), rng.uniform(0.f, 3000.f));
+        Tracker tracker;
+        tracker.setMaxDistance(60);
+        int frame = 0;
+        char label[32];
+        std::snprintf(label, sizeof(label), "%d robots", robots);
+        double ms = timeIt(reps, [&]() {
+            for (cv::Point2f &p : positions)
+                p += cv::Point2f(rng.uniform(-4.f, 4.f), rng.uniform(-4.f, 4.f));
+            tracker.update(frame++, positions);
+        });
+        results.push_back({"tracker update", label, ms});
+        std::printf("%-28s %10s %12.3f\n", "tracker update", label, ms);
+    }
+
+    if (!jsonPath.empty() && !writeJson(jsonPath, reps, results)) {
+        std::fprintf(stderr, "Could not write %s\n", jsonPath.c_str());
+        return 1;
+    }
+    if (!baselinePath.empty()) {
+        std::vector<Result> baseline;
+        if (!readJson(baselinePath, baseline)) {
+            std::fprintf(stderr, "Could not read baseline %s\n", baselinePath.c_str());
+            return 1;
+        }
+        int regressions = compareBaseline(results, baseline, tolerance);
+        std::printf("%d regression(s) against %s (tolerance %.2fx)\n", regressions, baselinePath.c_str(), tolerance);
+        if (regressions > 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "AsyncRunner.h"
+#include <QMetaObject>
+#include <QThread>
+
+AsyncRunner::AsyncRunner(QObject *parent)
+    : QObject(parent)
+{
+    _pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+AsyncRunner::~AsyncRunner()
+{
+    cancel();
+    // Jobs post back to this object, make sure none is still running
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void AsyncRunner::submit(const Job &job)
+{
+    // Supersede the job in flight, if any
+    cancel();
+
+    auto flag = std::make_shared<CancelFlag>(false);
+    _currentFlag = flag;
+    quint64 generation = ++_generation;
+
+    if (_running++ == 0)
+        emit busyChanged(true);
+
+    _pool.start([this, job, flag, generation]() {
+        Completion completion;
+        if (!flag->load()) {
+            try {
+                completion = job(*flag);
+            } catch (...) {
+                completion = Completion();
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, generation, completion]() {
+            _finished(generation, completion);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AsyncRunner::cancel()
+{
+    if (_currentFlag)
+        _currentFlag->store(true);
+    _currentFlag.reset();
+}
+
+void AsyncRunner::_finished(quint64 generation, const Completion &completion)
+{
+    // Only the newest request gets to publish its result
+    if (generation == _generation && _currentFlag && !_currentFlag->load()) {
+        _currentFlag.reset();
+        if (completion)
+            completion();
+    }
+
+    if (--_running == 0)
+        emit busyChanged(false);
+}
@@ -0,0 +1,44 @@
+#ifndef ASYNCRUNNER_H
+#define ASYNCRUNNER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Runs expensive image operations off the GUI thread.
+// Only the newest request matters: submitting a job cancels the one in flight,
+// and results of superseded jobs are dropped instead of being posted back.
+class AsyncRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Set to true when the job has been superseded, long jobs may poll it to stop early
+    using CancelFlag = std::atomic<bool>;
+    // Callback run on the GUI thread with the job's result
+    using Completion = std::function<void()>;
+    // Work run on a pool thread, returns the completion to post back (may be empty)
+    using Job = std::function<Completion(const CancelFlag &cancelled)>;
+
+    explicit AsyncRunner(QObject *parent = nullptr);
+    ~AsyncRunner();
+
+    void submit(const Job &job);
+    void cancel();
+    bool isBusy() const { return _running > 0; }
+
+signals:
+    void busyChanged(bool busy);
+
+private:
+    QThreadPool _pool;
+    std::shared_ptr<CancelFlag> _currentFlag;
+    quint64 _generation = 0;
+    int _running = 0;
+
+    void _finished(quint64 generation, const Completion &completion);
+};
+
+#endif // ASYNCRUNNER_H
@@ -0,0 +1,73 @@
+#include "Background.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <atomic>
+
+// Models are updated on the GUI thread and by the background learning job
+static uint64_t nextModelId()
+{
+    static std::atomic<uint64_t> id{0};
+    return ++id;
+}
+
+void BackgroundModel::setMode(Mode mode)
+{
+    if (mode == _mode) return;
+    _mode = mode;
+    reset();
+}
+
+void BackgroundModel::reset()
+{
+    _frames = 0;
+    _model = cv::Mat();
+    _background = cv::Mat();
+    _id = nextModelId();
+}
+
+void BackgroundModel::update(const cv::Mat &frame)
+{
+    cv::Mat gray;
+    maxChannelGray(frame, gray);
+
+    if (_frames == 0 || gray.size() != _model.size()) {
+        _frames = 0;
+        if (_mode == EXPONENTIAL_MEAN)
+            gray.convertTo(_model, CV_32F);
+        else
+            _model = gray.clone();
+    } else {
+        // The kernels update in place: never write into a buffer someone else holds
+        if (_model.u && _model.u->refcount > 1)
+            _model = _model.clone();
+        if (_mode == EXPONENTIAL_MEAN)
+            accumulateMean(gray, _model, std::max(_alpha, 1.0f / (_frames + 1)));
+        else
+            accumulateMedian(gray, _model);
+    }
+    _frames++;
+    _background = cv::Mat();
+    _id = nextModelId();
+}
+
+cv::Mat BackgroundModel::background() const
+{
+    if (_background.empty() && !_model.empty()) {
+        if (_mode == EXPONENTIAL_MEAN)
+            _model.convertTo(_background, CV_8U);
+        else
+            _background = _model.clone();
+    }
+    return _background;
+}
+
+cv::Mat subtractBackground(const cv::Mat &frame, const cv::Mat &background)
+{
+    if (background.empty() || background.size() != frame.size())
+        return frame;
+    cv::Mat gray;
+    maxChannelGray(frame, gray);
+    cv::Mat foreground;
+    cv::subtract(gray, background, foreground);
+    return foreground;
+}
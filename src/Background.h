@@ -0,0 +1,48 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+
+// Static arena learned over a frame sequence, on the max-channel gray.
+// Each frame updates the model incrementally, nothing is kept per frame.
+class BackgroundModel
+{
+public:
+    enum Mode {
+        EXPONENTIAL_MEAN,
+        APPROXIMATE_MEDIAN      // one gray level per frame toward the frame, robust to passing robots
+    };
+
+    // Changing the mode starts a new model
+    void setMode(Mode mode);
+    Mode mode() const { return _mode; }
+    // Learning rate of the mean, the first frames are plainly averaged
+    void setAlpha(float alpha) { _alpha = alpha; }
+    float alpha() const { return _alpha; }
+
+    void reset();
+    void update(const cv::Mat &frame);
+    int frames() const { return _frames; }
+    bool empty() const { return _frames == 0; }
+    // Changes on every update
+    uint64_t id() const { return _id; }
+
+    // CV_8UC1 background, never written once returned
+    cv::Mat background() const;
+
+private:
+    Mode _mode = APPROXIMATE_MEDIAN;
+    float _alpha = 0.02f;
+    int _frames = 0;
+    uint64_t _id = 0;
+    cv::Mat _model;                 // CV_32FC1 mean or CV_8UC1 median
+    mutable cv::Mat _background;    // built from _model on demand
+};
+
+// Max-channel gray minus the background, saturated at 0: robots brighter than the arena
+// remain, static glare and borders vanish. The frame is returned as is when the
+// background is empty or of another size.
+cv::Mat subtractBackground(const cv::Mat &frame, const cv::Mat &background);
+
+#endif // BACKGROUND_H
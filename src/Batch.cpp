@@ -0,0 +1,146 @@
+#include "Batch.h"
+#include "ParamSet.h"
+#include "Components.h"
+#include "Detection.h"
+#include "ResultCache.h"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static void usage()
+{
+    std::fprintf(stderr, "Usage: pogotrack_gui --batch <params.yml> <input dir> <output dir> [--threads N]\n"
+                         "                     [--cache <dir>] [--cache-mb N]\n");
+}
+
+static bool isImage(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".png" || ext == ".bmp" || ext == ".jpg" || ext == ".jpeg" || ext == ".tif" || ext == ".tiff";
+}
+
+// One line per detection: circles from Hough, centroids from connected components
+static bool writeDetections(const fs::path &path, const std::vector<cv::Vec3f> &circles, const ComponentsResult &cc)
+{
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "type,x,y,radius,area\n";
+    for (const cv::Vec3f &c : circles)
+        out << "circle," << c[0] << ',' << c[1] << ',' << c[2] << ",\n";
+    for (int i = 1; i < cc.count; i++)  // skip background (i=0)
+        out << "component," << cc.centroids.at<double>(i, 0) << ',' << cc.centroids.at<double>(i, 1)
+            << ",," << cc.stats.at<int>(i, cv::CC_STAT_AREA) << '\n';
+    return static_cast<bool>(out);
+}
+
+int runBatch(int argc, char *argv[])
+{
+    if (argc < 5) {
+        usage();
+        return 2;
+    }
+    const std::string paramsPath = argv[2];
+    const fs::path inputDir = argv[3];
+    const fs::path outputDir = argv[4];
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    fs::path cacheDir;
+    int cacheMB = 256;
+    for (int i = 5; i < argc; i++) {
+        if (std::string(argv[i]) == "--threads" && i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--cache" && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (std::string(argv[i]) == "--cache-mb" && i + 1 < argc)
+            cacheMB = std::max(1, std::atoi(argv[++i]));
+    }
+
+    ParamSet params;
+    if (!params.load(paramsPath)) {
+        std::fprintf(stderr, "Could not load parameters from %s\n", paramsPath.c_str());
+        return 1;
+    }
+
+    std::vector<fs::path> frames;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(inputDir, ec))
+        if (entry.is_regular_file() && isImage(entry.path()))
+            frames.push_back(entry.path());
+    if (ec) {
+        std::fprintf(stderr, "Could not read %s: %s\n", inputDir.string().c_str(), ec.message().c_str());
+        return 1;
+    }
+    std::sort(frames.begin(), frames.end());
+    fs::create_directories(outputDir, ec);
+
+    ResultCache cache;
+    if (!cacheDir.empty() && !cache.open(cacheDir, uint64_t(cacheMB) << 20))
+        std::fprintf(stderr, "Could not use %s as cache, running without\n", cacheDir.string().c_str());
+
+    // One frame per core rather than nested parallelism inside each operation;
+    // memory stays bounded to one frame in flight per thread
+    cv::setNumThreads(1);
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0};
+    std::mutex print;
+    auto worker = [&]() {
+        for (size_t i = next++; i < frames.size(); i = next++) {
+            const fs::path &path = frames[i];
+            cv::Mat frame = cv::imread(path.string(), cv::IMREAD_COLOR);
+            bool ok = !frame.empty();
+            if (ok) {
+                try {
+                    // A frame already processed with the same parameters is not processed again
+                    uint64_t key = cache.isOpen() ? params.cacheKey(frame) : 0;
+                    ResultCache::Entry entry;
+                    ComponentsResult cc;
+                    if (cache.isOpen() && cache.load(key, entry)) {
+                        cc.stats = entry.stats;
+                        cc.centroids = entry.centroids;
+                        cc.count = entry.stats.rows;
+                    } else {
+                        cv::Mat binary = params.binarize(frame);
+                        cc = labelComponents(binary, cv::CCL_SPAGHETTI, false);
+                        entry.circles = detectCircles(binary, params.hough, params.detector,
+                            params.mask.size() == binary.size() ? params.mask : cv::Mat());
+                        entry.stats = cc.stats;
+                        entry.centroids = cc.centroids;
+                        cache.store(key, entry);
+                    }
+                    ok = writeDetections(outputDir / (path.stem().string() + ".csv"), entry.circles, cc);
+                } catch (const cv::Exception &e) {
+                    std::lock_guard<std::mutex> lock(print);
+                    std::fprintf(stderr, "%s: %s\n", path.string().c_str(), e.what());
+                    ok = false;
+                }
+            }
+            std::lock_guard<std::mutex> lock(print);
+            if (!ok) {
+                failed++;
+                std::fprintf(stderr, "Failed: %s\n", path.string().c_str());
+            }
+            std::printf("[%zu/%zu] %s\n", i + 1, frames.size(), path.filename().string().c_str());
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < std::min<int>(threads, static_cast<int>(frames.size())); t++)
+        pool.emplace_back(worker);
+    for (std::thread &t : pool)
+        t.join();
+
+    std::printf("%zu frames, %d failed\n", frames.size(), failed.load());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Headless mode, no window is opened:
+//   pogotrack_gui --batch <params.yml> <input dir> <output dir> [--threads N]
+//                        [--cache <dir>] [--cache-mb N]
+// Runs the saved pipeline on every image of the input directory, one frame per thread,
+// and writes one CSV of detections per frame in the output directory. With a cache
+// directory, frames seen before with the same parameters reuse their stored detections.
+int runBatch(int argc, char *argv[]);
+
+#endif // BATCH_H
@@ -0,0 +1,117 @@
+#include "BinaryCodec.h"
+#include <algorithm>
+
+namespace {
+
+enum PackMethod : uchar {
+    RUN_LENGTHS = 0,
+    BITS        = 1
+};
+
+void putVarint(std::vector<uchar> &out, size_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uchar>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uchar>(v));
+}
+
+size_t getVarint(const uchar *&p, const uchar *end)
+{
+    size_t v = 0;
+    int shift = 0;
+    while (p < end) {
+        uchar b = *p++;
+        v |= static_cast<size_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+    return v;
+}
+
+} // namespace
+
+bool packBinary(const cv::Mat &img, std::vector<uchar> &packed)
+{
+    packed.clear();
+    if (img.empty() || img.type() != CV_8UC1)
+        return false;
+
+    cv::Mat m = img.isContinuous() ? img : img.clone();
+    const uchar *p = m.ptr<uchar>();
+    const size_t n = m.total();
+    const size_t bitsSize = 1 + (n + 7) / 8;
+
+    // Runs alternate between 0 and 255, starting with 0
+    packed.push_back(RUN_LENGTHS);
+    uchar value = 0;
+    size_t run = 0;
+    bool useBits = false;
+    for (size_t i = 0; i < n; i++) {
+        uchar v = p[i];
+        if (v != 0 && v != 255) {
+            packed.clear();
+            return false;
+        }
+        if (v == value) {
+            run++;
+            continue;
+        }
+        putVarint(packed, run);
+        value = v;
+        run = 1;
+        if (packed.size() >= bitsSize) {
+            useBits = true;
+            break;
+        }
+    }
+
+    if (!useBits) {
+        putVarint(packed, run);
+        packed.shrink_to_fit();
+        return true;
+    }
+
+    packed.assign(bitsSize, 0);
+    packed[0] = BITS;
+    for (size_t i = 0; i < n; i++) {
+        uchar v = p[i];
+        if (v != 0 && v != 255) {
+            packed.clear();
+            return false;
+        }
+        if (v)
+            packed[1 + i / 8] |= static_cast<uchar>(1 << (i % 8));
+    }
+    return true;
+}
+
+cv::Mat unpackBinary(const std::vector<uchar> &packed, cv::Size size)
+{
+    cv::Mat img(size, CV_8UC1, cv::Scalar(0));
+    if (packed.empty())
+        return img;
+
+    uchar *dst = img.ptr<uchar>();
+    const size_t n = img.total();
+    if (packed[0] == BITS) {
+        for (size_t i = 0; i < n; i++)
+            if (packed[1 + i / 8] & (1 << (i % 8)))
+                dst[i] = 255;
+        return img;
+    }
+
+    const uchar *p = packed.data() + 1;
+    const uchar *end = packed.data() + packed.size();
+    size_t pos = 0;
+    uchar value = 0;
+    while (p < end && pos < n) {
+        size_t run = std::min(getVarint(p, end), n - pos);
+        if (value)
+            std::fill(dst + pos, dst + pos + run, value);
+        pos += run;
+        value = 255 - value;
+    }
+    return img;
+}
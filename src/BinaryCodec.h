@@ -0,0 +1,14 @@
+#ifndef BINARYCODEC_H
+#define BINARYCODEC_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Compact lossless storage for binary (0 / 255) single channel images.
+// Uses run lengths, or one bit per pixel when the image is too noisy for runs to pay off.
+
+// Returns false, leaving `packed` empty, if the image is not binary
+bool packBinary(const cv::Mat &img, std::vector<uchar> &packed);
+cv::Mat unpackBinary(const std::vector<uchar> &packed, cv::Size size);
+
+#endif // BINARYCODEC_H
@@ -0,0 +1,205 @@
+#include "ComponentTree.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+namespace {
+
+// Union-find root, halving the path on the way
+inline int findRoot(std::vector<int> &zpar, int p)
+{
+    while (zpar[p] != p) {
+        zpar[p] = zpar[zpar[p]];
+        p = zpar[p];
+    }
+    return p;
+}
+
+} // namespace
+
+void ComponentTree::clear()
+{
+    _size = cv::Size();
+    _levels = std::vector<uint8_t>();
+    _parentLevels = std::vector<uint8_t>();
+    _nodes = std::vector<Node>();
+}
+
+size_t ComponentTree::bytes() const
+{
+    return _levels.capacity() + _parentLevels.capacity() + _nodes.capacity() * sizeof(Node);
+}
+
+bool ComponentTree::build(const cv::Mat &gray, const std::atomic<bool> *cancelled)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    clear();
+    auto stop = [&]() { return cancelled && cancelled->load(); };
+    // Pixels are addressed by their index, y * w + x
+    const cv::Mat image = gray.isContinuous() ? gray : gray.clone();
+    const uchar *f = image.ptr();
+    const int w = image.cols, h = image.rows;
+    const int total = w * h;
+
+    // Counting sort of the non zero pixels, brightest first
+    int hist[256] = {0};
+    for (int p = 0; p < total; p++)
+        hist[f[p]]++;
+    int offset[256];
+    int n = 0;
+    for (int v = 255; v >= 1; v--) {
+        offset[v] = n;
+        n += hist[v];
+    }
+    std::vector<int> order(n);
+    for (int p = 0; p < total; p++)
+        if (f[p]) order[offset[f[p]]++] = p;
+    if (stop()) return false;
+
+    // Each pixel joins the components of its already processed neighbours, all at least as
+    // bright, and becomes their parent. parent is -1 until a pixel is processed, and stays
+    // so for zero pixels.
+    std::vector<int> parent(total, -1);
+    std::vector<int> zpar(total);
+    for (int i = 0; i < n; i++) {
+        if ((i & 0xFFFF) == 0 && stop()) return false;
+        const int p = order[i];
+        parent[p] = zpar[p] = p;
+        const int x = p % w, y = p / w;
+        for (int dy = -1; dy <= 1; dy++) {
+            if (y + dy < 0 || y + dy >= h) continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                if ((dx == 0 && dy == 0) || x + dx < 0 || x + dx >= w) continue;
+                const int q = p + dy * w + dx;
+                if (parent[q] < 0) continue;
+                const int r = findRoot(zpar, q);
+                if (r != p)
+                    parent[r] = zpar[r] = p;
+            }
+        }
+    }
+    if (stop()) return false;
+
+    // Parents come after their children in order: walking it backwards, every pixel is
+    // pointed to the canonical pixel of its level, then numbered, parents first
+    for (int i = n - 1; i >= 0; i--) {
+        const int p = order[i];
+        const int q = parent[p];
+        if (f[parent[q]] == f[q])
+            parent[p] = parent[q];
+    }
+    std::vector<int> &nodeOf = zpar;
+    std::vector<int> nodeParent;
+    for (int i = n - 1; i >= 0; i--) {
+        const int p = order[i];
+        const int q = parent[p];
+        if (q == p || f[q] != f[p]) {
+            nodeOf[p] = static_cast<int>(_levels.size());
+            nodeParent.push_back(q == p ? -1 : nodeOf[q]);
+            _levels.push_back(f[p]);
+            _parentLevels.push_back(q == p ? 0 : f[q]);
+        } else {
+            nodeOf[p] = nodeOf[q];
+        }
+    }
+    order = std::vector<int>();
+    parent = std::vector<int>();
+    if (stop()) {
+        clear();
+        return false;
+    }
+
+    // Attributes of the pixels at each node's own level, then children into their parents
+    _nodes.resize(_levels.size());
+    for (int y = 0; y < h; y++) {
+        const uchar *row = f + size_t(y) * w;
+        const int *ids = nodeOf.data() + size_t(y) * w;
+        for (int x = 0; x < w; x++) {
+            if (!row[x]) continue;
+            Node &node = _nodes[ids[x]];
+            node.area++;
+            node.sumX += x;
+            node.sumY += y;
+            node.left = std::min(node.left, x);
+            node.right = std::max(node.right, x);
+            node.top = std::min(node.top, y);
+            node.bottom = std::max(node.bottom, y);
+        }
+    }
+    for (int id = static_cast<int>(_nodes.size()) - 1; id >= 0; id--) {
+        if (nodeParent[id] < 0) continue;
+        const Node &child = _nodes[id];
+        Node &node = _nodes[nodeParent[id]];
+        node.area += child.area;
+        node.sumX += child.sumX;
+        node.sumY += child.sumY;
+        node.left = std::min(node.left, child.left);
+        node.right = std::max(node.right, child.right);
+        node.top = std::min(node.top, child.top);
+        node.bottom = std::max(node.bottom, child.bottom);
+    }
+    _size = image.size();
+    return true;
+}
+
+std::vector<int> ComponentTree::counts(int minArea, int maxArea) const
+{
+    // A node is a component of gray > t for t in [parent level, level)
+    std::vector<int> diff(256, 0);
+    for (size_t i = 0; i < _levels.size(); i++) {
+        const int area = _nodes[i].area;
+        if (area < minArea || area > maxArea) continue;
+        diff[_parentLevels[i]]++;
+        diff[_levels[i]]--;
+    }
+    std::vector<int> result(256);
+    int running = 0;
+    for (int t = 0; t < 256; t++) {
+        running += diff[t];
+        result[t] = running;
+    }
+    return result;
+}
+
+int ComponentTree::components(int threshold, cv::Mat &stats, cv::Mat &centroids) const
+{
+    std::vector<int> selected;
+    for (size_t i = 0; i < _levels.size(); i++)
+        if (_parentLevels[i] <= threshold && threshold < _levels[i])
+            selected.push_back(static_cast<int>(i));
+
+    // Fresh buffers, the previous results may still be shared with the history
+    const int count = static_cast<int>(selected.size()) + 1;
+    stats = cv::Mat(count, 5, CV_32S);
+    centroids = cv::Mat(count, 2, CV_64F);
+    int64_t foreground = 0;
+    double sumX = 0, sumY = 0;
+    for (int k = 1; k < count; k++) {
+        const Node &node = _nodes[selected[k - 1]];
+        int *s = stats.ptr<int>(k);
+        s[cv::CC_STAT_LEFT] = node.left;
+        s[cv::CC_STAT_TOP] = node.top;
+        s[cv::CC_STAT_WIDTH] = node.right - node.left + 1;
+        s[cv::CC_STAT_HEIGHT] = node.bottom - node.top + 1;
+        s[cv::CC_STAT_AREA] = node.area;
+        double *c = centroids.ptr<double>(k);
+        c[0] = node.sumX / node.area;
+        c[1] = node.sumY / node.area;
+        foreground += node.area;
+        sumX += node.sumX;
+        sumY += node.sumY;
+    }
+
+    // Background: all the other pixels, their coordinate sums are the image's minus the components'
+    const int w = _size.width, h = _size.height;
+    const int64_t background = int64_t(w) * h - foreground;
+    int *s = stats.ptr<int>(0);
+    s[cv::CC_STAT_LEFT] = 0;
+    s[cv::CC_STAT_TOP] = 0;
+    s[cv::CC_STAT_WIDTH] = w;
+    s[cv::CC_STAT_HEIGHT] = h;
+    s[cv::CC_STAT_AREA] = static_cast<int>(background);
+    double *c = centroids.ptr<double>(0);
+    c[0] = background > 0 ? (0.5 * (w - 1) * w * h - sumX) / background : 0;
+    c[1] = background > 0 ? (0.5 * (h - 1) * h * w - sumY) / background : 0;
+    return count;
+}
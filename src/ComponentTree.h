@@ -0,0 +1,50 @@
+#ifndef COMPONENTTREE_H
+#define COMPONENTTREE_H
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+// Max-tree of a gray image: the connected components (8-connectivity, as labelComponents)
+// of every binary gray > t, nested in one tree. It is built once per image with a union-find
+// over the pixels sorted by decreasing gray level. A node is one component, the same set of
+// pixels for all thresholds in [parent level, level), so counts over the 256 thresholds and
+// the components at any one of them come from the nodes alone, without relabeling.
+// Zero pixels, everything outside a mask, are never foreground and are left out of the tree.
+class ComponentTree
+{
+public:
+    // 8 bits single channel. Returns false, with an empty tree, once cancelled is set.
+    bool build(const cv::Mat &gray, const std::atomic<bool> *cancelled = nullptr);
+    void clear();
+    bool empty() const { return _size.empty(); }
+    size_t nodeCount() const { return _levels.size(); }
+    size_t bytes() const;
+
+    // Number of components of gray > t for every t in [0, 255], counting only those
+    // with an area in [minArea, maxArea]
+    std::vector<int> counts(int minArea = 0, int maxArea = INT_MAX) const;
+
+    // Components of gray > threshold laid out as cv::connectedComponentsWithStats does,
+    // row 0 being the background (its bounding box is the whole image). Components come
+    // in tree order rather than raster order. Returns their number, background included.
+    int components(int threshold, cv::Mat &stats, cv::Mat &centroids) const;
+
+private:
+    struct Node {
+        int area = 0;
+        int left = INT_MAX, top = INT_MAX, right = -1, bottom = -1;
+        double sumX = 0, sumY = 0;
+    };
+
+    cv::Size _size;
+    // Per node, parents before their children. Levels are kept apart from the
+    // attributes so a threshold only scans two bytes per node.
+    std::vector<uint8_t> _levels;
+    std::vector<uint8_t> _parentLevels;   // 0 for the roots
+    std::vector<Node> _nodes;
+};
+
+#endif // COMPONENTTREE_H
@@ -0,0 +1,112 @@
+#include "Components.h"
+#include "Histogram.h"
+#include "Kernels.h"
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+
+cv::Mat colorizeLabels(const cv::Mat &labels, int count)
+{
+    CV_Assert(labels.type() == CV_32S);
+
+    // Same colors as ever for a given label, for display purpose
+    std::vector<cv::Vec3b> colors(std::max(count, 1));
+    cv::RNG rng(12345);
+    colors[0] = cv::Vec3b(0,0,0); // background
+    for (int i = 1; i < count; i++)
+        colors[i] = cv::Vec3b(rng.uniform(50,255), rng.uniform(50,255), rng.uniform(50,255));
+
+    cv::Mat colored(labels.size(), CV_8UC3);
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range &range) {
+        const cv::Vec3b *palette = colors.data();
+        for (int y = range.start; y < range.end; y++) {
+            const int *l = labels.ptr<int>(y);
+            cv::Vec3b *dst = colored.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < labels.cols; x++)
+                dst[x] = palette[l[x]];
+        }
+    }, std::max(1.0, labels.total() / 65536.0));
+    return colored;
+}
+
+namespace {
+
+// Region results back to the frame: offset positions, zero padded images
+void embedRegion(ComponentsResult &result, const cv::Size &size, const cv::Rect &region)
+{
+    cv::Mat labels(size, CV_32S, cv::Scalar(0));
+    result.labels.copyTo(labels(region));
+    if (result.display.data == result.labels.data)
+        result.display = labels;
+    else {
+        cv::Mat display(size, result.display.type(), cv::Scalar::all(0));
+        result.display.copyTo(display(region));
+        result.display = display;
+    }
+    result.labels = labels;
+
+    for (int i = 0; i < result.count; i++) {
+        result.stats.at<int>(i, cv::CC_STAT_LEFT) += region.x;
+        result.stats.at<int>(i, cv::CC_STAT_TOP) += region.y;
+        result.centroids.at<double>(i, 0) += region.x;
+        result.centroids.at<double>(i, 1) += region.y;
+    }
+    // The background also covers what is outside the region, its centroid is left as is
+    if (result.count > 0) {
+        int *bg = result.stats.ptr<int>(0);
+        bg[cv::CC_STAT_LEFT] = 0;
+        bg[cv::CC_STAT_TOP] = 0;
+        bg[cv::CC_STAT_WIDTH] = size.width;
+        bg[cv::CC_STAT_HEIGHT] = size.height;
+        bg[cv::CC_STAT_AREA] += size.area() - region.area();
+    }
+}
+
+} // namespace
+
+ComponentsResult labelComponents(const cv::Mat &image, int algorithm, bool colorize, const cv::Rect &region)
+{
+    const cv::Rect frame(0, 0, image.cols, image.rows);
+    const cv::Rect roi = region & frame;
+    if (!region.empty() && roi != frame) {
+        ComponentsResult result = labelComponents(image(roi), algorithm, colorize);
+        embedRegion(result, image.size(), roi);
+        return result;
+    }
+
+    ComponentsResult result;
+    cv::TickMeter tm;
+
+    // Ensure binary image (threshold if needed)
+    tm.start();
+    cv::Mat gray;
+    if (image.channels() == 3)
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    else
+        gray = image;
+
+    cv::Mat binImg;
+    cv::Mat hist = computeHistogram(gray);
+    int nonZeroLevels = cv::countNonZero(hist.colRange(1, 255));
+    if (nonZeroLevels == 0)
+        binImg = gray;  // already binary, no need for Otsu
+    else
+        thresholdMasked(gray, otsuThreshold(hist), cv::Mat(), binImg);
+    tm.stop();
+    result.binarizeMs = tm.getTimeMilli();
+
+    // Connected components
+    tm.reset();
+    tm.start();
+    result.count = cv::connectedComponentsWithStats(binImg, result.labels, result.stats, result.centroids,
+                                                    8, CV_32S, algorithm);
+    tm.stop();
+    result.labelingMs = tm.getTimeMilli();
+
+    tm.reset();
+    tm.start();
+    result.display = colorize ? colorizeLabels(result.labels, result.count) : result.labels;
+    tm.stop();
+    result.colorizeMs = tm.getTimeMilli();
+
+    return result;
+}
@@ -0,0 +1,30 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+struct ComponentsResult {
+    cv::Mat labels;       // CV_32S label map, 0 is background
+    cv::Mat stats;
+    cv::Mat centroids;
+    int count = 0;        // including background
+    cv::Mat display;      // colored labels, or the label map itself
+    // Time spent in each stage, in milliseconds
+    double binarizeMs = 0;
+    double labelingMs = 0;
+    double colorizeMs = 0;
+};
+
+// Binarizes the image (Otsu, skipped when already binary), labels it with the given
+// cv::ConnectedComponentsAlgorithmsTypes (CCL_SPAGHETTI and CCL_BBDT run in parallel),
+// then builds the display image: colored labels, or the label map when colorize is false.
+// With a region, typically the mask bounds, only that part is binarized and labeled; the
+// results keep full frame coordinates and everything outside is background.
+ComponentsResult labelComponents(const cv::Mat &image, int algorithm = cv::CCL_DEFAULT, bool colorize = true,
+                                 const cv::Rect &region = cv::Rect());
+
+// Palette lookup of a CV_32S label map into a BGR image, in parallel over rows
+cv::Mat colorizeLabels(const cv::Mat &labels, int count);
+
+#endif // COMPONENTS_H
@@ -0,0 +1,456 @@
+#include "Detection.h"
+#include "Histogram.h"
+#include "Kernels.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// mergeCircles, the scores kept
+std::vector<cv::Vec4f> mergeScored(std::vector<cv::Vec4f> circles, double minDist)
+{
+    // Circles on a tile seam come from several tiles: the strongest wins, whatever the tile order
+    std::stable_sort(circles.begin(), circles.end(),
+                     [](const cv::Vec4f &a, const cv::Vec4f &b) { return a[3] > b[3]; });
+    if (minDist <= 0)
+        return circles;
+    std::vector<cv::Vec4f> kept;
+    kept.reserve(circles.size());
+
+    // Grid of minDist cells: a close neighbour is in the same or an adjacent cell
+    std::unordered_map<long long, std::vector<int>> grid;
+    auto cellOf = [minDist](float v) { return static_cast<long long>(std::floor(v / minDist)); };
+    auto keyOf = [](long long cx, long long cy) { return (cy << 32) ^ (cx & 0xffffffffLL); };
+    const double minDist2 = minDist * minDist;
+
+    for (const cv::Vec4f &c : circles) {
+        long long cx = cellOf(c[0]), cy = cellOf(c[1]);
+        bool duplicate = false;
+        for (long long dy = -1; dy <= 1 && !duplicate; dy++)
+            for (long long dx = -1; dx <= 1 && !duplicate; dx++) {
+                auto it = grid.find(keyOf(cx + dx, cy + dy));
+                if (it == grid.end()) continue;
+                for (int k : it->second) {
+                    double ex = kept[k][0] - c[0], ey = kept[k][1] - c[1];
+                    if (ex * ex + ey * ey < minDist2) { duplicate = true; break; }
+                }
+            }
+        if (duplicate) continue;
+        grid[keyOf(cx, cy)].push_back(static_cast<int>(kept.size()));
+        kept.push_back(c);
+    }
+    return kept;
+}
+
+std::vector<cv::Vec3f> withoutScores(const std::vector<cv::Vec4f> &circles)
+{
+    std::vector<cv::Vec3f> result;
+    result.reserve(circles.size());
+    for (const cv::Vec4f &c : circles)
+        result.emplace_back(c[0], c[1], c[2]);
+    return result;
+}
+
+} // namespace
+
+std::vector<cv::Vec3f> mergeCircles(std::vector<cv::Vec4f> circles, double minDist)
+{
+    return withoutScores(mergeScored(std::move(circles), minDist));
+}
+
+namespace {
+
+// Bounding box of the mask, the whole image without one
+cv::Rect searchRegion(const cv::Mat &gray, const cv::Mat &mask)
+{
+    if (!mask.empty() && mask.size() == gray.size())
+        return cv::boundingRect(mask);
+    return cv::Rect(0, 0, gray.cols, gray.rows);
+}
+
+// Cores of the tiles covering roi, each tile being its core grown by margin
+std::vector<cv::Rect> tileCores(const cv::Rect &roi, int margin)
+{
+    int core = std::max(roi.width, roi.height);
+    if (margin > 0) {
+        // Enough tiles to keep every thread busy, each large compared to the robots
+        double area = static_cast<double>(roi.width) * roi.height;
+        int threads = std::max(1, cv::getNumThreads());
+        core = static_cast<int>(std::sqrt(area / (2.0 * threads)));
+        core = std::clamp(core, 4 * margin, 2048);
+    }
+
+    std::vector<cv::Rect> cores;
+    for (int y = roi.y; y < roi.y + roi.height; y += core)
+        for (int x = roi.x; x < roi.x + roi.width; x += core)
+            cores.emplace_back(cv::Rect(x, y, core, core) & roi);
+    return cores;
+}
+
+// houghCirclesTiled with the accumulator votes of each circle
+std::vector<cv::Vec4f> houghScored(const cv::Mat &gray, const HoughParams &params,
+                                   const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+
+    // Only the masked region can hold robots
+    cv::Rect roi = searchRegion(gray, mask);
+    if (roi.empty()) return {};
+
+    // A non positive maxRadius lets OpenCV pick it from the image size: no safe overlap, single tile
+    const int margin = params.maxRadius > 0 ? params.maxRadius + 2 : 0;
+    std::vector<cv::Rect> cores = tileCores(roi, margin);
+
+    std::vector<std::vector<cv::Vec4f>> found(cores.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(cores.size())), [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; t++) {
+            if (cancelled && cancelled->load()) return;
+            const cv::Rect &c = cores[t];
+            cv::Rect tile = cv::Rect(c.x - margin, c.y - margin, c.width + 2 * margin, c.height + 2 * margin)
+                          & cv::Rect(0, 0, gray.cols, gray.rows);
+
+            // Four components: the accumulator votes come along, to merge across seams
+            std::vector<cv::Vec4f> circles;
+            cv::HoughCircles(gray(tile), circles, cv::HOUGH_GRADIENT,
+                             params.dp, params.minDist,
+                             params.param1, params.param2,
+                             params.minRadius, params.maxRadius);
+            // Keep the circles centered in this tile's core, in image coordinates
+            for (cv::Vec4f circle : circles) {
+                circle[0] += tile.x;
+                circle[1] += tile.y;
+                if (c.contains(cv::Point(cvFloor(circle[0]), cvFloor(circle[1]))))
+                    found[t].push_back(circle);
+            }
+        }
+    }, static_cast<double>(cores.size()));
+
+    std::vector<cv::Vec4f> circles;
+    for (const auto &f : found)
+        circles.insert(circles.end(), f.begin(), f.end());
+    return mergeScored(std::move(circles), params.minDist);
+}
+
+} // namespace
+
+std::vector<cv::Vec3f> houghCirclesTiled(const cv::Mat &gray, const HoughParams &params,
+                                         const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    return withoutScores(houghScored(gray, params, mask, cancelled));
+}
+
+namespace {
+
+// Pixels at rounded distance r from the center, with their outward unit direction
+struct Ring {
+    std::vector<cv::Point> offsets;
+    std::vector<cv::Point2f> directions;
+};
+
+// Radial direction components over every ring of a radius band, as two correlation kernels
+struct AnnulusKernel {
+    cv::Mat kx;
+    cv::Mat ky;
+};
+
+// Rings and kernels are the same for every frame, built on first use and kept
+std::mutex kernelMutex;
+std::map<int, std::shared_ptr<const Ring>> ringCache;
+std::map<std::pair<int, int>, std::shared_ptr<const AnnulusKernel>> kernelCache;
+
+std::shared_ptr<const Ring> ringFor(int radius)
+{
+    std::lock_guard<std::mutex> lock(kernelMutex);
+    std::shared_ptr<const Ring> &cached = ringCache[radius];
+    if (cached) return cached;
+
+    auto ring = std::make_shared<Ring>();
+    for (int dy = -radius - 1; dy <= radius + 1; dy++)
+        for (int dx = -radius - 1; dx <= radius + 1; dx++) {
+            double d = std::sqrt(double(dx * dx + dy * dy));
+            if (cvRound(d) != radius || d == 0) continue;
+            ring->offsets.emplace_back(dx, dy);
+            ring->directions.emplace_back(float(dx / d), float(dy / d));
+        }
+    cached = ring;
+    return cached;
+}
+
+std::shared_ptr<const AnnulusKernel> annulusKernel(int minRadius, int maxRadius)
+{
+    {
+        std::lock_guard<std::mutex> lock(kernelMutex);
+        auto it = kernelCache.find({minRadius, maxRadius});
+        if (it != kernelCache.end()) return it->second;
+    }
+
+    const int size = 2 * maxRadius + 3;
+    const int c = maxRadius + 1;
+    auto kernel = std::make_shared<AnnulusKernel>();
+    kernel->kx = cv::Mat::zeros(size, size, CV_32F);
+    kernel->ky = cv::Mat::zeros(size, size, CV_32F);
+    for (int r = minRadius; r <= maxRadius; r++) {
+        std::shared_ptr<const Ring> ring = ringFor(r);
+        for (size_t i = 0; i < ring->offsets.size(); i++) {
+            const cv::Point &o = ring->offsets[i];
+            kernel->kx.at<float>(c + o.y, c + o.x) = ring->directions[i].x;
+            kernel->ky.at<float>(c + o.y, c + o.x) = ring->directions[i].y;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(kernelMutex);
+    return kernelCache.emplace(std::make_pair(minRadius, maxRadius), kernel).first->second;
+}
+
+struct Peak {
+    float x, y, radius, score;
+};
+
+// annulusCircles with the votes of each center
+std::vector<cv::Vec4f> annulusScored(const cv::Mat &gray, const HoughParams &params,
+                                     const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    if (params.maxRadius <= 0 || params.maxRadius < params.minRadius)
+        CV_Error(cv::Error::StsBadArg, "the annulus detector needs 0 < maxRadius and minRadius <= maxRadius");
+
+    cv::Rect roi = searchRegion(gray, mask);
+    if (roi.empty()) return {};
+
+    // dp > 1: same search on an image dp times smaller
+    const double dp = std::max(1.0, params.dp);
+    cv::Mat src = gray(roi);
+    if (dp > 1.0)
+        cv::resize(src, src, cv::Size(), 1.0 / dp, 1.0 / dp, cv::INTER_AREA);
+    const int minRadius = std::max(1, cvRound(params.minRadius / dp));
+    const int maxRadius = std::max(minRadius, cvRound(params.maxRadius / dp));
+    const double minDist = params.minDist / dp;
+    std::shared_ptr<const AnnulusKernel> kernel = annulusKernel(minRadius, maxRadius);
+    std::vector<std::shared_ptr<const Ring>> rings;
+    for (int r = minRadius; r <= maxRadius; r++)
+        rings.push_back(ringFor(r));
+
+    const int margin = maxRadius + 2;
+    const cv::Rect area(0, 0, src.cols, src.rows);
+    std::vector<cv::Rect> cores = tileCores(area, margin);
+    std::vector<std::vector<Peak>> found(cores.size());
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(cores.size())), [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; t++) {
+            if (cancelled && cancelled->load()) return;
+            const cv::Rect &c = cores[t];
+            cv::Rect tile = cv::Rect(c.x - margin, c.y - margin, c.width + 2 * margin, c.height + 2 * margin) & area;
+            cv::Mat in = src(tile);
+
+            // Unit gradient directions on thin edges, thresholds as HOUGH_GRADIENT uses them
+            cv::Mat edges, gx, gy;
+            cv::Canny(in, edges, std::max(params.param1 / 2, 1.0), params.param1, 3);
+            cv::Sobel(in, gx, CV_32F, 1, 0);
+            cv::Sobel(in, gy, CV_32F, 0, 1);
+            cv::Mat nx(in.size(), CV_32F, cv::Scalar(0)), ny(in.size(), CV_32F, cv::Scalar(0));
+            for (int y = 0; y < in.rows; y++) {
+                const uchar *e = edges.ptr<uchar>(y);
+                const float *px = gx.ptr<float>(y), *py = gy.ptr<float>(y);
+                float *qx = nx.ptr<float>(y), *qy = ny.ptr<float>(y);
+                for (int x = 0; x < in.cols; x++) {
+                    if (!e[x]) continue;
+                    float m = std::sqrt(px[x] * px[x] + py[x] * py[x]);
+                    if (m > 0) {
+                        qx[x] = px[x] / m;
+                        qy[x] = py[x] / m;
+                    }
+                }
+            }
+
+            // Votes of a center: edge pixels of the annulus whose gradient points to or away
+            // from it. filter2D correlates through the DFT at these kernel sizes.
+            cv::Mat vx, vy, votes;
+            cv::filter2D(nx, vx, CV_32F, kernel->kx, cv::Point(-1, -1), 0, cv::BORDER_CONSTANT);
+            cv::filter2D(ny, vy, CV_32F, kernel->ky, cv::Point(-1, -1), 0, cv::BORDER_CONSTANT);
+            votes = cv::abs(vx + vy);
+
+            // Local maxima in this tile's core
+            cv::Mat dilated;
+            cv::dilate(votes, dilated, cv::Mat());
+            const cv::Rect local = c - tile.tl();
+            for (int y = local.y; y < local.y + local.height; y++) {
+                const float *v = votes.ptr<float>(y), *d = dilated.ptr<float>(y);
+                for (int x = local.x; x < local.x + local.width; x++) {
+                    if (v[x] < params.param2 || v[x] < d[x]) continue;
+
+                    // Radius: the ring of the band with the best coverage
+                    int bestRadius = minRadius;
+                    float bestCoverage = -1;
+                    for (int r = minRadius; r <= maxRadius; r++) {
+                        const Ring &ring = *rings[r - minRadius];
+                        float sum = 0;
+                        for (size_t i = 0; i < ring.offsets.size(); i++) {
+                            int sx = x + ring.offsets[i].x, sy = y + ring.offsets[i].y;
+                            if (sx < 0 || sy < 0 || sx >= in.cols || sy >= in.rows) continue;
+                            sum += nx.at<float>(sy, sx) * ring.directions[i].x
+                                 + ny.at<float>(sy, sx) * ring.directions[i].y;
+                        }
+                        float coverage = std::abs(sum) / ring.offsets.size();
+                        if (coverage > bestCoverage) {
+                            bestCoverage = coverage;
+                            bestRadius = r;
+                        }
+                    }
+                    found[t].push_back({float(x + tile.x), float(y + tile.y), float(bestRadius), v[x]});
+                }
+            }
+        }
+    }, static_cast<double>(cores.size()));
+
+    // Suppression keeps the best center of each robot
+    std::vector<cv::Vec4f> peaks;
+    for (const auto &f : found)
+        for (const Peak &p : f)
+            peaks.emplace_back(p.x, p.y, p.radius, p.score);
+    std::vector<cv::Vec4f> circles = mergeScored(std::move(peaks), std::max(minDist, 1.0));
+
+    // Back to image coordinates
+    for (cv::Vec4f &c : circles) {
+        c[0] = float(c[0] * dp + roi.x);
+        c[1] = float(c[1] * dp + roi.y);
+        c[2] = float(c[2] * dp);
+    }
+    return circles;
+}
+
+} // namespace
+
+std::vector<cv::Vec3f> annulusCircles(const cv::Mat &gray, const HoughParams &params,
+                                      const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    return withoutScores(annulusScored(gray, params, mask, cancelled));
+}
+
+std::vector<cv::Vec3f> blobCircles(const cv::Mat &gray, const HoughParams &params,
+                                   const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+
+    cv::Rect roi = searchRegion(gray, mask);
+    if (roi.empty()) return {};
+
+    // Thresholded frames are used as they are, anything else goes through Otsu
+    cv::Mat binary = gray;
+    cv::Mat hist = computeHistogram(gray(roi));
+    if (cv::countNonZero(hist.colRange(1, 255)) > 0)
+        thresholdMasked(gray, otsuThreshold(hist), cv::Mat(), binary);
+
+    // A blob of radius up to maxRadius centered in a core fits whole in its tile.
+    // Without maxRadius there is no bound, and a single tile.
+    const double maxRadius = params.maxRadius > 0 ? params.maxRadius : std::numeric_limits<double>::max();
+    const int margin = params.maxRadius > 0 ? 2 * params.maxRadius + 2 : 0;
+    std::vector<cv::Rect> cores = tileCores(roi, margin);
+    std::vector<std::vector<cv::Vec4f>> found(cores.size());
+    const cv::Rect frame(0, 0, gray.cols, gray.rows);
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(cores.size())), [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; t++) {
+            if (cancelled && cancelled->load()) return;
+            const cv::Rect &c = cores[t];
+            cv::Rect tile = cv::Rect(c.x - margin, c.y - margin, c.width + 2 * margin, c.height + 2 * margin) & frame;
+
+            // findContours leaves its input untouched since OpenCV 3.2
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(binary(tile), contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+            for (const std::vector<cv::Point> &contour : contours) {
+                // Cut by a tile seam: whole in the tile owning its center, if it is a robot
+                cv::Rect box = cv::boundingRect(contour) + tile.tl();
+                if ((box.x == tile.x && tile.x > 0) || (box.y == tile.y && tile.y > 0) ||
+                    (box.br().x == tile.br().x && tile.br().x < frame.width) ||
+                    (box.br().y == tile.br().y && tile.br().y < frame.height))
+                    continue;
+
+                double area = cv::contourArea(contour);
+                double equivalent = std::sqrt(area / CV_PI);
+                if (equivalent < params.minRadius || equivalent > maxRadius) continue;
+                double perimeter = cv::arcLength(contour, true);
+                double circularity = perimeter > 0 ? 4 * CV_PI * area / (perimeter * perimeter) : 0;
+                if (perimeter <= 0 || circularity < params.minCircularity)
+                    continue;
+
+                cv::Point2f center;
+                float radius;
+                if (contour.size() >= 5) {
+                    cv::RotatedRect ellipse = cv::fitEllipse(contour);
+                    center = ellipse.center;
+                    radius = (ellipse.size.width + ellipse.size.height) / 4;
+                } else
+                    cv::minEnclosingCircle(contour, center, radius);
+                center += cv::Point2f(float(tile.x), float(tile.y));
+                if (c.contains(cv::Point(cvFloor(center.x), cvFloor(center.y))))
+                    found[t].emplace_back(center.x, center.y, radius, float(circularity));
+            }
+        }
+    }, static_cast<double>(cores.size()));
+
+    // The roundest of close blobs is kept
+    std::vector<cv::Vec4f> circles;
+    for (const auto &f : found)
+        circles.insert(circles.end(), f.begin(), f.end());
+    return mergeCircles(std::move(circles), params.minDist);
+}
+
+std::vector<cv::Vec3f> detectCircles(const cv::Mat &gray, const HoughParams &params, circleDetector detector,
+                                     const cv::Mat &mask, const std::atomic<bool> *cancelled)
+{
+    if (detector == ANNULUS_DETECTOR)
+        return annulusCircles(gray, params, mask, cancelled);
+    if (detector == BLOB_DETECTOR)
+        return blobCircles(gray, params, mask, cancelled);
+    return houghCirclesTiled(gray, params, mask, cancelled);
+}
+
+cv::Mat houghSweep(const cv::Mat &gray, const HoughParams &base,
+                   const std::vector<double> &param1Values, const std::vector<double> &param2Values,
+                   const cv::Mat &mask, const std::atomic<bool> *cancelled, circleDetector detector)
+{
+    const int rows = static_cast<int>(param1Values.size());
+    const int cols = static_cast<int>(param2Values.size());
+    cv::Mat counts(rows, cols, CV_32S, cv::Scalar(-1));
+    if (rows == 0 || cols == 0) return counts;
+
+    // Blobs read neither parameter, one detection fills the grid
+    if (detector == BLOB_DETECTOR) {
+        size_t found = blobCircles(gray, base, mask, cancelled).size();
+        if (!(cancelled && cancelled->load()))
+            counts.setTo(cv::Scalar(static_cast<int>(found)));
+        return counts;
+    }
+
+    // One detection per param1 row, at the lowest param2: the edges, and for the annulus the
+    // correlation and its local maxima, are computed once per row. Merging keeps the highest
+    // scored circles first, so those whose votes reach a higher param2 are the ones a detection
+    // with it keeps. Rows run in parallel, nested parallel_for_ calls sequentially on the worker,
+    // so the tiling is the same as a single run.
+    const double lowest = *std::min_element(param2Values.begin(), param2Values.end());
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+        for (int row = range.start; row < range.end; row++) {
+            if (cancelled && cancelled->load()) return;
+            HoughParams params = base;
+            params.param1 = param1Values[row];
+            params.param2 = lowest;
+            std::vector<cv::Vec4f> circles = detector == ANNULUS_DETECTOR
+                                           ? annulusScored(gray, params, mask, cancelled)
+                                           : houghScored(gray, params, mask, cancelled);
+            if (cancelled && cancelled->load()) return;  // partial detection
+            int *count = counts.ptr<int>(row);
+            for (int col = 0; col < cols; col++)
+                count[col] = static_cast<int>(std::count_if(circles.begin(), circles.end(),
+                    [&](const cv::Vec4f &c) { return c[3] >= param2Values[col]; }));
+        }
+    }, static_cast<double>(rows));
+    return counts;
+}
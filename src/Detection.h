@@ -0,0 +1,62 @@
+#ifndef DETECTION_H
+#define DETECTION_H
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <vector>
+#include "Params.h"
+
+// cv::HoughCircles (HOUGH_GRADIENT) limited to the bounding box of the mask, split in
+// tiles processed in parallel. Tiles overlap by maxRadius so every circle fits whole in
+// the tile owning its center, and of circles closer than minDist across seams the one with
+// the most accumulator votes is kept.
+// The mask may be empty. Returns early, with what was found so far, once cancelled is set.
+std::vector<cv::Vec3f> houghCirclesTiled(const cv::Mat &gray, const HoughParams &params,
+                                         const cv::Mat &mask = cv::Mat(),
+                                         const std::atomic<bool> *cancelled = nullptr);
+
+// Detector for a narrow radius band, all robots having about the same size. Unit gradient
+// directions on the Canny edges (param1, as HOUGH_GRADIENT uses it) are correlated through
+// the DFT with the radial directions of an annulus covering [minRadius, maxRadius]. A center
+// gets one vote per edge pixel of the annulus pointing to or away from it; centers with at
+// least param2 votes are local maxima, then suppressed within minDist strongest first, and
+// the radius is the ring of the band with the best coverage. dp > 1 runs on an image dp
+// times smaller. Rings and kernels are cached per radius. Same tiling, mask and cancellation
+// as houghCirclesTiled.
+std::vector<cv::Vec3f> annulusCircles(const cv::Mat &gray, const HoughParams &params,
+                                      const cv::Mat &mask = cv::Mat(),
+                                      const std::atomic<bool> *cancelled = nullptr);
+
+// Fast path for clean binary frames, where thresholding already separates the robots.
+// External contours of the foreground (Otsu first if the image is not binary) become
+// circles: center and radius from a fitted ellipse. Blobs are kept when their equivalent
+// radius sqrt(area / pi) is within [minRadius, maxRadius] and their circularity at least
+// minCircularity, then merged within minDist. Tiles run in parallel, overlapping enough
+// for any kept blob to be whole in the tile owning its center. param1, param2 and dp
+// are not used.
+std::vector<cv::Vec3f> blobCircles(const cv::Mat &gray, const HoughParams &params,
+                                   const cv::Mat &mask = cv::Mat(),
+                                   const std::atomic<bool> *cancelled = nullptr);
+
+// houghCirclesTiled, annulusCircles or blobCircles
+std::vector<cv::Vec3f> detectCircles(const cv::Mat &gray, const HoughParams &params, circleDetector detector,
+                                     const cv::Mat &mask = cv::Mat(),
+                                     const std::atomic<bool> *cancelled = nullptr);
+
+// Number of circles the detector finds for every (param1, param2) pair, other parameters
+// from base. One detection runs per param1 value, at the lowest param2, and a circle counts
+// for every param2 its votes reach, Hough accumulator or annulus votes. Blobs read neither
+// parameter: one detection fills the grid. The gray image and the mask are shared.
+// Returns a CV_32S matrix, one row per param1 value and one column per param2 value;
+// cells left once cancelled is set hold -1.
+cv::Mat houghSweep(const cv::Mat &gray, const HoughParams &base,
+                   const std::vector<double> &param1Values, const std::vector<double> &param2Values,
+                   const cv::Mat &mask = cv::Mat(), const std::atomic<bool> *cancelled = nullptr,
+                   circleDetector detector = HOUGH_GRADIENT_DETECTOR);
+
+// Circles as (x, y, radius, score), the score being comparable across tiles: Hough votes,
+// annulus votes or blob circularity. Keeps the highest scored of any circles whose centers
+// are closer than minDist, the first one on ties. Returns them highest scored first.
+std::vector<cv::Vec3f> mergeCircles(std::vector<cv::Vec4f> circles, double minDist);
+
+#endif // DETECTION_H
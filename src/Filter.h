@@ -3,6 +3,8 @@
 
 #include <opencv2/opencv.hpp>
 #include <QString>
+#include <functional>
+#include <memory>
 
 class Filter
 {
@@ -10,6 +12,17 @@ public:
     virtual ~Filter() {}
     virtual QString name() const = 0;
     virtual cv::Mat apply(const cv::Mat& input) = 0;
+    // Identifies the current parameters, the pipeline recomputes the stage when it changes
+    virtual size_t paramsKey() const { return 0; }
+    // Copy of the stage, used to run it off the GUI thread
+    virtual std::unique_ptr<Filter> clone() const = 0;
 };
 
+// Mixes a value into a parameter key
+template <typename T>
+inline size_t hashCombine(size_t seed, const T &value)
+{
+    return seed ^ (std::hash<T>()(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
 #endif // FILTER_H
@@ -0,0 +1,108 @@
+#include "Filters.h"
+#include "Kernels.h"
+#include "Histogram.h"
+#include "Background.h"
+
+void ForegroundFilter::setBackground(const cv::Mat &background, size_t backgroundId)
+{
+    _background = background;
+    _backgroundId = background.empty() ? 0 : backgroundId;
+}
+
+cv::Mat ForegroundFilter::apply(const cv::Mat& input)
+{
+    return subtractBackground(input, _background);
+}
+
+cv::Mat MaxChannelFilter::apply(const cv::Mat& input)
+{
+    cv::Mat maxGray;
+    maxChannelGray(input, maxGray);
+    return maxGray;
+}
+
+void MaskFilter::setMask(const cv::Mat &mask)
+{
+    static size_t nextId = 0;
+    _mask = mask;
+    _runs = mask.empty() ? nullptr : std::make_shared<const MaskRuns>(MaskRuns::fromMask(mask));
+    // Masks are compared by identity, a new mask always invalidates the stage
+    _maskId = mask.empty() ? 0 : ++nextId;
+}
+
+void MaskFilter::shareMask(const MaskFilter &other)
+{
+    _mask = other._mask;
+    _runs = other._runs;
+    _maskId = other._maskId;
+}
+
+cv::Mat MaskFilter::apply(const cv::Mat& input)
+{
+    if (!_runs || _runs->size != input.size())
+        return input;
+
+    cv::Mat maskedImage;
+    copyRuns(input, *_runs, maskedImage);
+    return maskedImage;
+}
+
+cv::Mat ThresholdFilter::apply(const cv::Mat& input)
+{
+    cv::Mat binary;
+    if (_runs && _runs->size == input.size())
+        thresholdRuns(input, _threshold, *_runs, binary);
+    else
+        thresholdMasked(input, _threshold, cv::Mat(), binary);
+    return binary;
+}
+
+size_t AdaptiveThresholdFilter::paramsKey() const
+{
+    size_t key = std::hash<int>()(_params.method);
+    key = hashCombine(key, _params.blockSize);
+    key = hashCombine(key, _params.C);
+    if (_runs) {
+        key = hashCombine(key, _runs->bounds.x);
+        key = hashCombine(key, _runs->bounds.y);
+        key = hashCombine(key, _runs->bounds.width);
+        key = hashCombine(key, _runs->bounds.height);
+    }
+    return key;
+}
+
+cv::Mat AdaptiveThresholdFilter::apply(const cv::Mat& input)
+{
+    int blockSize = _params.blockSize;
+    if (blockSize % 2 == 0) blockSize += 1; // must be odd
+    int method = (_params.method == MEAN_C) ? cv::ADAPTIVE_THRESH_MEAN_C : cv::ADAPTIVE_THRESH_GAUSSIAN_C;
+
+    const cv::Rect frame(0, 0, input.cols, input.rows);
+    const cv::Rect region = _runs && _runs->size == input.size() ? _runs->bounds : frame;
+    if (region.empty() || region == frame) {
+        cv::Mat binary;
+        cv::adaptiveThreshold(input, binary, 255, method,
+                              cv::THRESH_BINARY, blockSize, _params.C);
+        return binary;
+    }
+
+    // The pixels of the region see the same neighbourhood as in the full image,
+    // as long as half a block around it is part of the computation
+    const int margin = blockSize / 2;
+    const cv::Rect padded = cv::Rect(region.x - margin, region.y - margin,
+                                     region.width + 2 * margin, region.height + 2 * margin) & frame;
+    cv::Mat local;
+    cv::adaptiveThreshold(input(padded), local, 255, method,
+                          cv::THRESH_BINARY, blockSize, _params.C);
+
+    cv::Mat binary(input.size(), CV_8UC1, cv::Scalar(0));
+    local(region - padded.tl()).copyTo(binary(region));
+    return binary;
+}
+
+cv::Mat HistogramFilter::apply(const cv::Mat& input)
+{
+    if (!_runs || _runs->size != input.size())
+        return computeHistogram(input);
+    return computeHistogram(input, *_runs);
+}
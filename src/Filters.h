@@ -0,0 +1,114 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include "Filter.h"
+#include "Params.h"
+#include "MaskRuns.h"
+#include <memory>
+
+// Foreground over a learned background (see subtractBackground), passes the input
+// through when no background is set
+class ForegroundFilter : public Filter
+{
+public:
+    QString name() const override { return "Foreground"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    size_t paramsKey() const override { return _backgroundId; }
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<ForegroundFilter>(*this); }
+
+    void setBackground(const cv::Mat &background, size_t backgroundId);
+    const cv::Mat &background() const { return _background; }
+
+private:
+    cv::Mat _background;
+    size_t _backgroundId = 0;
+};
+
+// Single channel grayscale holding the max over B, G and R
+class MaxChannelFilter : public Filter
+{
+public:
+    QString name() const override { return "Max channel"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<MaxChannelFilter>(*this); }
+};
+
+// Zeroes everything outside the mask, passes the input through when no mask is set.
+// The mask is kept as runs too, so only its covered spans are copied.
+class MaskFilter : public Filter
+{
+public:
+    QString name() const override { return "Mask"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    size_t paramsKey() const override { return _maskId; }
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<MaskFilter>(*this); }
+
+    void setMask(const cv::Mat &mask);
+    // Same mask as another stage, without scanning it again
+    void shareMask(const MaskFilter &other);
+    const cv::Mat &mask() const { return _mask; }
+    size_t maskId() const { return _maskId; }
+    // Null when no mask is set
+    const std::shared_ptr<const MaskRuns> &runs() const { return _runs; }
+
+private:
+    cv::Mat _mask;
+    std::shared_ptr<const MaskRuns> _runs;
+    size_t _maskId = 0;
+};
+
+// Binary threshold, restricted to the spans of a mask when one is set
+class ThresholdFilter : public Filter
+{
+public:
+    QString name() const override { return "Threshold"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    size_t paramsKey() const override { return hashCombine(std::hash<double>()(_threshold), _maskId); }
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<ThresholdFilter>(*this); }
+
+    void setThreshold(double threshold) { _threshold = threshold; }
+    double threshold() const { return _threshold; }
+    void setRegion(const std::shared_ptr<const MaskRuns> &runs, size_t maskId) { _runs = runs; _maskId = maskId; }
+
+private:
+    double _threshold = 255;
+    std::shared_ptr<const MaskRuns> _runs;
+    size_t _maskId = 0;
+};
+
+class AdaptiveThresholdFilter : public Filter
+{
+public:
+    QString name() const override { return "Adaptative threshold"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    size_t paramsKey() const override;
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<AdaptiveThresholdFilter>(*this); }
+
+    void setParams(const AdaptativeParams &params) { _params = params; }
+    const AdaptativeParams &params() const { return _params; }
+    // Only the mask bounds (and the block around their border) are computed, the rest is zero.
+    // Null, or runs of another frame size, means the whole image.
+    void setRegion(const std::shared_ptr<const MaskRuns> &runs) { _runs = runs; }
+
+private:
+    AdaptativeParams _params = {MEAN_C, 11, -10.0};
+    std::shared_ptr<const MaskRuns> _runs;
+};
+
+// 1x256 CV_32S histogram of the gray levels inside the mask
+class HistogramFilter : public Filter
+{
+public:
+    QString name() const override { return "Histogram"; }
+    cv::Mat apply(const cv::Mat& input) override;
+    size_t paramsKey() const override { return _maskId; }
+    std::unique_ptr<Filter> clone() const override { return std::make_unique<HistogramFilter>(*this); }
+
+    void setRegion(const std::shared_ptr<const MaskRuns> &runs, size_t maskId) { _runs = runs; _maskId = maskId; }
+
+private:
+    std::shared_ptr<const MaskRuns> _runs;
+    size_t _maskId = 0;
+};
+
+#endif // FILTERS_H
@@ -0,0 +1,140 @@
+#include "Histogram.h"
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <mutex>
+
+cv::Mat computeHistogram(const cv::Mat &gray, const cv::Mat &mask)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == gray.size()));
+
+    cv::Mat hist = cv::Mat::zeros(1, 256, CV_32S);
+    int *total = hist.ptr<int>();
+    std::mutex merge;
+
+    // Each stripe fills its own histogram, merged once at the end
+    cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range &range) {
+        int local[256] = {0};
+        for (int y = range.start; y < range.end; y++) {
+            const uchar *p = gray.ptr<uchar>(y);
+            if (mask.empty()) {
+                for (int x = 0; x < gray.cols; x++)
+                    local[p[x]]++;
+            } else {
+                const uchar *m = mask.ptr<uchar>(y);
+                for (int x = 0; x < gray.cols; x++)
+                    if (m[x]) local[p[x]]++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(merge);
+        for (int i = 0; i < 256; i++)
+            total[i] += local[i];
+    }, std::max(1.0, gray.total() / 262144.0));
+
+    return hist;
+}
+
+cv::Mat computeHistogram(const cv::Mat &gray, const MaskRuns &runs)
+{
+    CV_Assert(gray.type() == CV_8UC1 && gray.size() == runs.size);
+
+    cv::Mat hist = cv::Mat::zeros(1, 256, CV_32S);
+    int *total = hist.ptr<int>();
+    std::mutex merge;
+
+    const cv::Rect &b = runs.bounds;
+    cv::parallel_for_(cv::Range(b.y, b.y + b.height), [&](const cv::Range &range) {
+        int local[256] = {0};
+        for (int y = range.start; y < range.end; y++) {
+            const uchar *p = gray.ptr<uchar>(y);
+            for (const MaskRuns::Span *s = runs.rowBegin(y); s != runs.rowEnd(y); s++)
+                for (int x = s->x0; x < s->x1; x++)
+                    local[p[x]]++;
+        }
+        std::lock_guard<std::mutex> lock(merge);
+        for (int i = 0; i < 256; i++)
+            total[i] += local[i];
+    }, std::max(1.0, runs.area / 262144.0));
+
+    return hist;
+}
+
+int otsuThreshold(const cv::Mat &hist)
+{
+    const int *h = hist.ptr<int>();
+    double count = 0, mu = 0;
+    for (int i = 0; i < 256; i++) {
+        count += h[i];
+        mu += i * (double)h[i];
+    }
+    if (count == 0) return 0;
+    mu /= count;
+
+    double q1 = 0, mu1 = 0, maxSigma = 0;
+    int best = 0;
+    for (int i = 0; i < 256; i++) {
+        double p = h[i] / count;
+        mu1 *= q1;
+        q1 += p;
+        double q2 = 1. - q1;
+        if (std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1. - FLT_EPSILON)
+            continue;
+        mu1 = (mu1 + i * p) / q1;
+        double mu2 = (mu - q1 * mu1) / q2;
+        double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+        if (sigma > maxSigma) {
+            maxSigma = sigma;
+            best = i;
+        }
+    }
+    return best;
+}
+
+int triangleThreshold(const cv::Mat &hist)
+{
+    const int N = 256;
+    int h[N];
+    std::copy(hist.ptr<int>(), hist.ptr<int>() + N, h);
+
+    int left = 0, right = 0, peak = 0, peakCount = 0;
+    for (int i = 0; i < N; i++)
+        if (h[i] > 0) { left = i; break; }
+    if (left > 0) left--;
+    for (int i = N - 1; i > 0; i--)
+        if (h[i] > 0) { right = i; break; }
+    if (right < N - 1) right++;
+    for (int i = 0; i < N; i++)
+        if (h[i] > peakCount) { peakCount = h[i]; peak = i; }
+
+    // The line is drawn towards the longest tail
+    bool flipped = false;
+    if (peak - left < right - peak) {
+        flipped = true;
+        std::reverse(h, h + N);
+        left = N - 1 - right;
+        peak = N - 1 - peak;
+    }
+
+    int thresh = left;
+    double a = peakCount, b = left - peak, dist = 0;
+    for (int i = left + 1; i <= peak; i++) {
+        double d = a * i + b * h[i];
+        if (d > dist) {
+            dist = d;
+            thresh = i;
+        }
+    }
+    thresh--;
+
+    return flipped ? N - 1 - thresh : thresh;
+}
+
+cv::Mat thresholdLut(double thresh)
+{
+    cv::Mat lut(1, 256, CV_8U);
+    int t = cvFloor(thresh);
+    for (int i = 0; i < 256; i++)
+        lut.at<uchar>(i) = i > t ? 255 : 0;
+    return lut;
+}
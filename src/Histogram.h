@@ -0,0 +1,21 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <opencv2/core.hpp>
+#include "MaskRuns.h"
+
+// 256 bins histogram of an 8 bit single channel image, as a 1x256 CV_32S row.
+// Pixels outside the mask are not counted, the mask may be empty.
+cv::Mat computeHistogram(const cv::Mat &gray, const cv::Mat &mask = cv::Mat());
+// Same over the spans of a run-length mask, only the covered pixels are read
+cv::Mat computeHistogram(const cv::Mat &gray, const MaskRuns &runs);
+
+// Threshold suggestions read from a histogram, same results as cv::threshold
+// with THRESH_OTSU / THRESH_TRIANGLE on the pixels it was computed from
+int otsuThreshold(const cv::Mat &hist);
+int triangleThreshold(const cv::Mat &hist);
+
+// 256 entries CV_8U lookup table giving the binary threshold output for each gray level
+cv::Mat thresholdLut(double thresh);
+
+#endif // HISTOGRAM_H
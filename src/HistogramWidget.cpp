@@ -0,0 +1,150 @@
+#include "HistogramWidget.h"
+#include <QPainter>
+#include <QMouseEvent>
+#include <algorithm>
+#include <cmath>
+
+HistogramWidget::HistogramWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(70);
+    setMaximumHeight(70);
+    setToolTip("Click to set the threshold\nBlue: Otsu - Orange: Triangle\n"
+               "Green: components per threshold - Magenta: those of a robot's area");
+}
+
+void HistogramWidget::setHistogram(const cv::Mat &hist)
+{
+    _bins.assign(256, 0.0);
+    if (!hist.empty()) {
+        const int *h = hist.ptr<int>();
+        double maxLog = 0;
+        for (int i = 0; i < 256; i++) {
+            _bins[i] = std::log1p((double)h[i]);
+            maxLog = std::max(maxLog, _bins[i]);
+        }
+        if (maxLog > 0)
+            for (double &b : _bins) b /= maxLog;
+    }
+    _buildPath();
+    update();
+}
+
+void HistogramWidget::setThreshold(int threshold)
+{
+    if (threshold == _threshold) return;
+    _threshold = threshold;
+    update();
+}
+
+void HistogramWidget::setSuggestions(int otsu, int triangle)
+{
+    _otsu = otsu;
+    _triangle = triangle;
+    update();
+}
+
+void HistogramWidget::setCounts(const std::vector<int> &all, const std::vector<int> &robots)
+{
+    _counts = all;
+    _robotCounts = robots;
+    _maxCountLog = 0;
+    for (int c : _counts)
+        _maxCountLog = std::max(_maxCountLog, std::log1p((double)c));
+    _buildCountPaths();
+    update();
+}
+
+void HistogramWidget::setExpectedCount(int expected)
+{
+    if (expected == _expected) return;
+    _expected = expected;
+    update();
+}
+
+void HistogramWidget::clear()
+{
+    _bins.clear();
+    _path = QPainterPath();
+    _counts.clear();
+    _robotCounts.clear();
+    _buildCountPaths();
+    _otsu = _triangle = -1;
+    update();
+}
+
+double HistogramWidget::_binToX(double bin) const
+{
+    return bin * (width() - 1) / 255.0;
+}
+
+void HistogramWidget::_buildPath()
+{
+    _path = QPainterPath();
+    if (_bins.empty()) return;
+    double h = height();
+    _path.moveTo(0, h);
+    for (int i = 0; i < 256; i++)
+        _path.lineTo(_binToX(i), h - _bins[i] * h);
+    _path.lineTo(_binToX(255), h);
+    _path.closeSubpath();
+}
+
+double HistogramWidget::_countToY(int count) const
+{
+    double h = height();
+    return _maxCountLog > 0 ? h - std::log1p((double)count) / _maxCountLog * h : h;
+}
+
+void HistogramWidget::_buildCountPaths()
+{
+    auto curve = [this](const std::vector<int> &counts) {
+        QPainterPath path;
+        if (counts.size() != 256) return path;
+        path.moveTo(_binToX(0), _countToY(counts[0]));
+        for (int i = 1; i < 256; i++)
+            path.lineTo(_binToX(i), _countToY(counts[i]));
+        return path;
+    };
+    _countsPath = curve(_counts);
+    _robotCountsPath = curve(_robotCounts);
+}
+
+void HistogramWidget::resizeEvent(QResizeEvent *)
+{
+    _buildPath();
+    _buildCountPaths();
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(40, 40, 40));
+    if (_bins.empty()) return;
+
+    painter.fillPath(_path, QColor(200, 200, 200));
+    if (!_counts.empty()) {
+        painter.strokePath(_countsPath, QPen(QColor(60, 200, 90), 1));
+        painter.strokePath(_robotCountsPath, QPen(QColor(230, 60, 220), 1));
+        if (_expected > 0) {
+            painter.setPen(QPen(QColor(230, 60, 220), 1, Qt::DashLine));
+            painter.drawLine(QPointF(0, _countToY(_expected)), QPointF(width(), _countToY(_expected)));
+        }
+    }
+
+    auto marker = [&](int bin, const QColor &color) {
+        if (bin < 0) return;
+        painter.setPen(QPen(color, 1));
+        painter.drawLine(QPointF(_binToX(bin), 0), QPointF(_binToX(bin), height()));
+    };
+    marker(_otsu, QColor(80, 160, 255));
+    marker(_triangle, QColor(255, 160, 40));
+    marker(_threshold, Qt::red);
+}
+
+void HistogramWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (_bins.empty() || width() <= 1) return;
+    int bin = std::lround(event->position().x() * 255.0 / (width() - 1));
+    emit thresholdPicked(std::clamp(bin, 0, 255));
+}
@@ -0,0 +1,55 @@
+#ifndef HISTOGRAMWIDGET_H
+#define HISTOGRAMWIDGET_H
+
+#include <QWidget>
+#include <QPainterPath>
+#include <opencv2/core.hpp>
+
+// Log-scaled gray level histogram with the current threshold and suggested ones. Component
+// counts per threshold may be drawn over it, on their own log scale.
+class HistogramWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistogramWidget(QWidget *parent = nullptr);
+
+    void setHistogram(const cv::Mat &hist);
+    void setThreshold(int threshold);
+    void setSuggestions(int otsu, int triangle);
+    // Components of gray > t for every t, all of them and those of a robot's area.
+    // Empty vectors remove the curves.
+    void setCounts(const std::vector<int> &all, const std::vector<int> &robots);
+    // Expected number of robots, drawn as a level on the counts scale, 0 for none
+    void setExpectedCount(int expected);
+    void clear();
+
+signals:
+    // Threshold picked by clicking on the histogram
+    void thresholdPicked(int threshold);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    std::vector<double> _bins;   // log counts normalized to [0, 1]
+    QPainterPath _path;          // cached outline, rebuilt on histogram change or resize
+    std::vector<int> _counts;
+    std::vector<int> _robotCounts;
+    QPainterPath _countsPath;    // cached like _path
+    QPainterPath _robotCountsPath;
+    double _maxCountLog = 0;
+    int _expected = 0;
+    int _threshold = 255;
+    int _otsu = -1;
+    int _triangle = -1;
+
+    void _buildPath();
+    void _buildCountPaths();
+    double _countToY(int count) const;
+    double _binToX(double bin) const;
+};
+
+#endif // HISTOGRAMWIDGET_H
@@ -0,0 +1,140 @@
+#include "History.h"
+#include "BinaryCodec.h"
+#include <cstdlib>
+#include <set>
+
+History::Command History::Command::then(const QString &nextName, const Replay &next) const
+{
+    Command command;
+    command.name = name.isEmpty() ? nextName : name + " > " + nextName;
+    Replay first = replay;
+    command.replay = [first, next](const cv::Mat &input) {
+        return next(first ? first(input) : input);
+    };
+    return command;
+}
+
+void History::setBudget(size_t bytes)
+{
+    _budget = bytes;
+    _enforceBudget();
+}
+
+size_t History::bytesUsed() const
+{
+    // Buffers are shared between entries (and with the source), count each one once
+    std::set<const uchar*> seen;
+    if (!_source.empty())
+        seen.insert(_source.datastart);
+    auto account = [&seen](const cv::Mat &m) -> size_t {
+        if (m.empty() || !seen.insert(m.datastart).second)
+            return 0;
+        return static_cast<size_t>(m.dataend - m.datastart);
+    };
+
+    size_t total = 0;
+    for (const Entry &e : _entries) {
+        total += account(e.state.image);
+        total += account(e.state.ccstats);
+        total += account(e.state.cccentroids);
+        total += e.state.circles.size() * sizeof(cv::Vec3f);
+        total += e.packed.capacity();
+    }
+    return total;
+}
+
+void History::clear(const cv::Mat &source)
+{
+    _entries.clear();
+    _index = -1;
+    _source = source;
+}
+
+void History::push(const Command &command, const State &state)
+{
+    _entries.resize(_index + 1);
+    if (_index >= 0)
+        _leave(_index);
+
+    Entry entry;
+    entry.command = command;
+    entry.state = state;
+    entry.size = state.image.size();
+    // Binary images are stored compressed, the full buffer is only held while current
+    if (state.image.datastart != _source.datastart)
+        packBinary(state.image, entry.packed);
+
+    _entries.push_back(std::move(entry));
+    _index++;
+    _enforceBudget();
+}
+
+History::State History::undo()
+{
+    if (canUndo()) {
+        _leave(_index);
+        _index--;
+    }
+    State state = _stateAt(_index);
+    _enforceBudget();
+    return state;
+}
+
+History::State History::redo()
+{
+    if (canRedo()) {
+        _leave(_index);
+        _index++;
+    }
+    State state = _stateAt(_index);
+    _enforceBudget();
+    return state;
+}
+
+History::State History::_stateAt(int index)
+{
+    if (index < 0)
+        return State();
+    Entry &entry = _entries[index];
+    entry.state.image = _imageAt(index);
+    return entry.state;
+}
+
+cv::Mat History::_imageAt(int index)
+{
+    const Entry &entry = _entries[index];
+    if (!entry.state.image.empty())
+        return entry.state.image;
+    if (!entry.packed.empty())
+        return unpackBinary(entry.packed, entry.size);
+    // Evicted: replay the commands on the source
+    return entry.command.run(_source);
+}
+
+void History::_leave(int index)
+{
+    // The compressed copy is enough once the entry is no longer displayed
+    Entry &entry = _entries[index];
+    if (!entry.packed.empty())
+        entry.state.image = cv::Mat();
+}
+
+void History::_enforceBudget()
+{
+    while (bytesUsed() > _budget) {
+        // Drop the snapshot farthest from the current entry
+        int victim = -1;
+        for (int i = 0; i < size(); i++) {
+            if (i == _index) continue;
+            const Entry &e = _entries[i];
+            bool holdsImage = !e.state.image.empty() && e.state.image.datastart != _source.datastart;
+            if (!holdsImage && e.packed.empty()) continue;
+            if (victim < 0 || std::abs(i - _index) > std::abs(victim - _index))
+                victim = i;
+        }
+        if (victim < 0)
+            break;
+        _entries[victim].state.image = cv::Mat();
+        std::vector<uchar>().swap(_entries[victim].packed);
+    }
+}
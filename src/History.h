@@ -0,0 +1,75 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <opencv2/core.hpp>
+#include <QString>
+#include <functional>
+#include <vector>
+
+// Undo / redo history with a memory budget.
+// Each entry records the commands that produced its image from the source image,
+// and a snapshot: a shared reference to the image buffer, or a compressed copy when
+// the image is binary. Snapshots far from the current entry are dropped when over
+// budget, and rebuilt by replaying the commands when that entry is reached again.
+class History
+{
+public:
+    // Builds an image from the result of the previous command
+    using Replay = std::function<cv::Mat(const cv::Mat &input)>;
+
+    // Operations and their parameters, captured in the replay, applied to the source image
+    struct Command {
+        QString name;
+        Replay replay;          // empty: the source image itself
+
+        // This command followed by another one
+        Command then(const QString &nextName, const Replay &next) const;
+        cv::Mat run(const cv::Mat &source) const { return replay ? replay(source) : source; }
+    };
+
+    // Everything an undo restores
+    struct State {
+        cv::Mat image;
+        uint8_t overlays = 0;
+        cv::Mat ccstats;
+        cv::Mat cccentroids;
+        std::vector<cv::Vec3f> circles;
+    };
+
+    void setBudget(size_t bytes);
+    size_t budget() const { return _budget; }
+    size_t bytesUsed() const;
+
+    // Starts a new history, buffers shared with the source image are not accounted
+    void clear(const cv::Mat &source);
+    // Adds a state after the current one, dropping any redo
+    void push(const Command &command, const State &state);
+
+    int index() const { return _index; }
+    int size() const { return static_cast<int>(_entries.size()); }
+    bool canUndo() const { return _index > 0; }
+    bool canRedo() const { return _index + 1 < size(); }
+    const Command &command() const { return _entries[_index].command; }
+    State undo();
+    State redo();
+
+private:
+    struct Entry {
+        Command command;
+        State state;                // state.image is empty once released or evicted
+        std::vector<uchar> packed;  // compressed binary image, if any
+        cv::Size size;
+    };
+
+    std::vector<Entry> _entries;
+    int _index = -1;
+    cv::Mat _source;
+    size_t _budget = 512u << 20;
+
+    State _stateAt(int index);
+    cv::Mat _imageAt(int index);
+    void _leave(int index);
+    void _enforceBudget();
+};
+
+#endif // HISTORY_H
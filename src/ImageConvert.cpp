@@ -0,0 +1,21 @@
+#include "ImageConvert.h"
+
+QImage matToQImage(const cv::Mat &mat)
+{
+    cv::Mat src = mat;
+    // Other depths (e.g. label maps) are stretched to 8 bits
+    if (src.depth() != CV_8U)
+        cv::normalize(mat, src, 0, 255, cv::NORM_MINMAX, CV_8U);
+
+    QImage::Format format;
+    switch (src.channels()) {
+        case 1: format = QImage::Format_Grayscale8; break;
+        case 3: format = QImage::Format_BGR888; break;
+        case 4: format = QImage::Format_ARGB32; break;  // BGRA in memory
+        default: return QImage();
+    }
+
+    cv::Mat *owner = new cv::Mat(src);
+    return QImage(static_cast<const uchar*>(owner->data), owner->cols, owner->rows, owner->step, format,
+                  [](void *info) { delete static_cast<cv::Mat*>(info); }, owner);
+}
@@ -0,0 +1,11 @@
+#ifndef IMAGECONVERT_H
+#define IMAGECONVERT_H
+
+#include <QImage>
+#include <opencv2/core.hpp>
+
+// Wrap cv::Mat into a QImage without conversion nor copy: grayscale as Grayscale8,
+// BGR as BGR888. The QImage is read-only and keeps a reference on the Mat's buffer.
+QImage matToQImage(const cv::Mat &mat);
+
+#endif // IMAGECONVERT_H
@@ -1,7 +1,10 @@
 #include "ImageDisplay.h"
+#include "ImageConvert.h"
+#include "Trace.h"
 #include <QPainter>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <algorithm>
 #include <cmath>
 
 
@@ -14,6 +17,9 @@ ImageDisplay::ImageDisplay(QWidget *parent)
 {
     setMouseTracking(true);
 
+    pyramid = new TilePyramid(this);
+    connect(pyramid, &TilePyramid::tileReady, this, [this]() { update(); });
+
     positionLabel = new QLabel(this);
     positionLabel->setText("");
     positionLabel->setStyleSheet("color: white; background-color: rgba(0,0,0,128);"); // optional styling
@@ -45,20 +51,77 @@ ImageDisplay::ImageDisplay(QWidget *parent)
     lineLabel2->setMinimumWidth(180);  // ensure enough width
     lineLabel2->setAlignment(Qt::AlignLeft | Qt::AlignBottom);
     lineLabel2->show();
+
+    statsLabel = new QLabel(this);
+    statsLabel->setText("");
+    statsLabel->setStyleSheet("color: white; background-color: rgba(0,0,0,128);");
+    statsLabel->move(10, 90);
+    statsLabel->setMinimumWidth(180);
+    statsLabel->setAlignment(Qt::AlignLeft | Qt::AlignBottom);
+    statsLabel->show();
+
+    // Opaque, so refreshing it does not repaint the image below
+    hudLabel = new QLabel(this);
+    QPalette hudPalette = hudLabel->palette();
+    hudPalette.setColor(QPalette::Window, Qt::black);
+    hudPalette.setColor(QPalette::WindowText, Qt::white);
+    hudLabel->setPalette(hudPalette);
+    hudLabel->setAutoFillBackground(true);
+    hudLabel->setFont(QFont("monospace", 8));
+    hudLabel->setTextFormat(Qt::PlainText);
+    hudLabel->move(10, 115);
+    hudLabel->hide();
+    hudTimer = new QTimer(this);
+    hudTimer->setInterval(250);
+    connect(hudTimer, &QTimer::timeout, this, &ImageDisplay::refreshHud);
+    paintClock.start();
+}
+
+void ImageDisplay::setHudVisible(bool visible)
+{
+    hudLabel->setVisible(visible);
+    if (visible) {
+        refreshHud();
+        hudTimer->start();
+    } else {
+        hudTimer->stop();
+        paintTimes.clear();
+    }
 }
 
-// Convert cv::Mat (BGR) to QImage (RGB)
-QImage ImageDisplay::matToQImage(const cv::Mat &mat)
+void ImageDisplay::setHudOperation(const QString &name, double ms)
 {
-    cv::Mat rgb;
-    if(mat.channels() == 3)
-        cv::cvtColor(mat, rgb, cv::COLOR_BGR2RGB);
-    else if(mat.channels() == 1)
-        cv::cvtColor(mat, rgb, cv::COLOR_GRAY2RGB);
-    else
-        rgb = mat;
-
-    return QImage((const uchar*)rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_RGB888).copy();
+    hudOperation = name;
+    hudOperationMs = ms;
+}
+
+void ImageDisplay::setHudMemory(size_t original, size_t current, size_t undo)
+{
+    hudOriginal = original;
+    hudCurrent = current;
+    hudUndo = undo;
+}
+
+void ImageDisplay::refreshHud()
+{
+    qint64 now = paintClock.elapsed();
+    while (!paintTimes.empty() && paintTimes.front() < now - 1000)
+        paintTimes.pop_front();
+
+    auto mb = [](size_t bytes) { return QString::number(bytes / double(1 << 20), 'f', 1) + " MB"; };
+    size_t images = qimgCopyBytes + (lutBuffer.empty() ? 0 : lutBuffer.total()) + pyramid->cacheBytes();
+    size_t overlays = _ccOverlay.bytes() + _houghOverlay.bytes() + _trackOverlay.bytes() + regionStats.bytes();
+    size_t total = hudOriginal + hudCurrent + hudUndo + images + overlays;
+
+    QString text = QString("Last op   %1 %2 ms\n").arg(hudOperation.isEmpty() ? "-" : hudOperation)
+                                                 .arg(hudOperationMs, 0, 'f', 1);
+    text += QString("Paint     %1 ms, %2 fps\n").arg(lastPaintMs, 0, 'f', 1).arg(paintTimes.size());
+    text += QString("Memory    %1\n").arg(mb(total));
+    text += QString("  original %1, current %2\n").arg(mb(hudOriginal), mb(hudCurrent));
+    text += QString("  undo %1, QImage %2, overlays %3").arg(mb(hudUndo), mb(images), mb(overlays));
+    if (text == hudLabel->text()) return;
+    hudLabel->setText(text);
+    hudLabel->adjustSize();
 }
 
 QString ImageDisplay::getPixelValue(const QPoint &widgetPos) const
@@ -67,8 +130,9 @@ QString ImageDisplay::getPixelValue(const QPoint &widgetPos) const
         return QString();
 
     // Map widget coordinates to image coordinates (account for pan & scale)
-    int x = std::round((widgetPos.x() - panOffset.x()) / scale);
-    int y = std::round((widgetPos.y() - panOffset.y()) / scale);
+    // A preview holds one pixel every previewFactor
+    int x = std::round((widgetPos.x() - panOffset.x()) / scale) / previewFactor;
+    int y = std::round((widgetPos.y() - panOffset.y()) / scale) / previewFactor;
 
     // Check bounds
     if (x < 0 || y < 0 || x >= qimg.width() || y >= qimg.height())
@@ -95,7 +159,7 @@ QString ImageDisplay::getPixelPosition(const QPoint &widgetPos) const
     int y = std::round((widgetPos.y() - panOffset.y()) / scale);
 
     // Check bounds
-    if (x < 0 || y < 0 || x >= qimg.width() || y >= qimg.height())
+    if (x < 0 || y < 0 || x >= qimg.width() * previewFactor || y >= qimg.height() * previewFactor)
         return QString();
     return QString("X: %1 - Y: %2")
                 .arg((double)x, 6, 'f', 0)
@@ -105,23 +169,65 @@ QString ImageDisplay::getPixelPosition(const QPoint &widgetPos) const
 
 void ImageDisplay::setImage(const cv::Mat &mat)
 {
+    TRACE_SCOPE("ImageDisplay::setImage");
     qimg = matToQImage(mat);
+    qimgCopyBytes = qimg.constBits() == mat.data ? 0 : qimg.sizeInBytes();
+    previewFactor = 1;
+    if (mat.data != statsSource.data || mat.size() != statsSource.size()) {
+        statsSource = mat;
+        regionStats.clear();
+    }
+    pyramid->setImage(qimg);
+    update();
+}
+
+void ImageDisplay::setPreview(const cv::Mat &mat, int factor)
+{
+    TRACE_SCOPE("ImageDisplay::setPreview");
+    setImage(mat);
+    previewFactor = std::max(1, factor);
+    statsSource.release();
+    regionStats.clear();
+}
+
+void ImageDisplay::setImageLut(const cv::Mat &gray, const cv::Mat &lut)
+{
+    TRACE_SCOPE("ImageDisplay::setImageLut");
+    CV_Assert(gray.type() == CV_8UC1);
+    // Drop the pyramid's tiles and reference first
+    pyramid->clear();
+    // Reuse the preview buffer when it is displayed and nobody else reads it, so previews do not allocate
+    bool reuse = !lutBuffer.empty() && lutBuffer.size() == gray.size()
+              && qimg.constBits() == lutBuffer.data && qimg.isDetached();
+    if (!reuse) {
+        lutBuffer = cv::Mat(gray.size(), CV_8UC1);
+        qimg = matToQImage(lutBuffer);
+        qimgCopyBytes = 0;   // counted as lutBuffer
+    }
+
+    cv::LUT(gray, lut, lutBuffer);
+    previewFactor = 1;
+    // Statistics of the gray levels the preview thresholds, what a threshold is picked from.
+    // The gray stage result stays the same while the slider moves.
+    if (gray.data != statsSource.data || gray.size() != statsSource.size()) {
+        statsSource = gray;
+        regionStats.clear();
+    }
+    pyramid->setImage(qimg);
     update();
 }
 
 void ImageDisplay::paintEvent(QPaintEvent *)
 {
+    TRACE_SCOPE("ImageDisplay::paintEvent");
+    qint64 paintStart = hudLabel->isVisible() ? paintClock.nsecsElapsed() : -1;
     QPainter painter(this);
     painter.setRenderHint(QPainter::LosslessImageRendering);
 
     painter.fillRect(rect(), QColor(200, 200, 200));
 
-    if (!qimg.isNull()) {
-        // Draw image with scaling and panning
-        QPoint topLeft = panOffset;
-        QSize scaledSize(qimg.width() * scale, qimg.height() * scale);
-        painter.drawImage(QRect(topLeft, scaledSize), qimg);
-    }
+    // Draw image with scaling and panning, only the visible tiles
+    pyramid->draw(painter, rect(), panOffset, scale * previewFactor);
     if (leftDragging){
         // Draw current dragging circle
         painter.setPen(QPen(Qt::red, 3));
@@ -151,42 +257,20 @@ void ImageDisplay::paintEvent(QPaintEvent *)
                 break;
         }
     }
+    // Overlays: only the items in view are drawn
+    QRectF visible(-panOffset.x() / scale, -panOffset.y() / scale,
+                   width() / scale, height() / scale);
     if (_drawCC)
-    {
-        painter.setPen(QPen(Qt::yellow, 2));
-
-        for (size_t i = 0; i < _ccCenters.size(); i++)
-        {
-            QPointF p(
-                _ccCenters[i].x() * scale + panOffset.x(),
-                _ccCenters[i].y() * scale + panOffset.y()
-            );
-
-            // Draw centroid
-            painter.drawEllipse(p, 4, 4);
-
-            // Draw area text
-            painter.drawText(p + QPointF(6, -6),
-                            QString::number(_ccAreas[i]) + " (" + QString::number(_ccCenters[i].x(), 'f', 0) + ", " + QString::number(_ccCenters[i].y(), 'f', 0) + ")");
-        }
-    }
+        _ccOverlay.draw(painter, visible, panOffset, scale);
     if (_drawHough)
-    {
-        painter.setPen(QPen(Qt::green, 2));
-
-        for (const auto& circle : _circles)
-        {
-            QPoint center(
-                circle[0] * scale + panOffset.x(),
-                circle[1] * scale + panOffset.y()
-            );
-            int radius = circle[2] * scale;
+        _houghOverlay.draw(painter, visible, panOffset, scale);
+    if (_drawTracks)
+        _trackOverlay.draw(painter, visible, panOffset, scale);
 
-            // Draw circle
-            painter.drawEllipse(center, radius, radius);
-        }
+    if (paintStart >= 0) {
+        lastPaintMs = (paintClock.nsecsElapsed() - paintStart) / 1e6;
+        paintTimes.push_back(paintClock.elapsed());
     }
-
 }
 
 void ImageDisplay::mousePressEvent(QMouseEvent *event)
@@ -243,6 +327,7 @@ void ImageDisplay::setLabelLine() const{
     double trueLength = std::sqrt(std::pow(x2-x1, 2) + std::pow(y2-y1, 2));
     lineLabel->setText("Length: " + QString("%1").arg(trueLength,  6, 'f', 0));
     lineLabel2->setText("");
+    statsLabel->setText("");
 }
 
 void ImageDisplay::setLabelRect() const{
@@ -260,6 +345,9 @@ void ImageDisplay::setLabelRect() const{
     double heightLength = std::abs(y2 - y1);
     lineLabel->setText(QString("W: %1 - H: %2").arg(widthLength,  6, 'f', 0).arg(heightLength, 6, 'f', 0));
     lineLabel2->setText(QString("Cx: %1 - Cy: %2").arg((double)center.x(),  6, 'f', 0).arg((double)center.y(), 6, 'f', 0));
+    if (leftDragging)
+        setLabelStats(statsIndex().rect(cv::Rect(std::min(x1, x2), std::min(y1, y2),
+                                                std::abs(x2 - x1) + 1, std::abs(y2 - y1) + 1)));
 }
 
 void ImageDisplay::setLabelCirc() const{
@@ -274,6 +362,29 @@ void ImageDisplay::setLabelCirc() const{
     double radius = std::sqrt(dx*dx + dy*dy) / 2;
     lineLabel->setText(QString("R: %1").arg(radius,  6, 'f', 0));
     lineLabel2->setText(QString("Cx: %1 - Cy: %2").arg((double)center.x(),  6, 'f', 0).arg((double)center.y(), 6, 'f', 0));
+    if (leftDragging)
+        setLabelStats(statsIndex().circle(cv::Point(center.x(), center.y()), static_cast<int>(radius)));
+}
+
+const RegionStatsIndex &ImageDisplay::statsIndex() const{
+    // Built once per displayed image, queries are then independent of its size
+    if (regionStats.empty() && !statsSource.empty())
+        regionStats.build(statsSource);
+    return regionStats;
+}
+
+void ImageDisplay::setLabelStats(const RegionStats &stats) const{
+    if (stats.count == 0) {
+        statsLabel->setText("");
+        return;
+    }
+    statsLabel->setText(QString("Mean: %1 - SD: %2 - Min: %3 - Max: %4 - Fg: %5%")
+                        .arg(stats.mean, 0, 'f', 1)
+                        .arg(stats.stddev, 0, 'f', 1)
+                        .arg(stats.min)
+                        .arg(stats.max)
+                        .arg(stats.foreground * 100, 0, 'f', 1));
+    statsLabel->adjustSize();
 }
 
 
@@ -306,20 +417,9 @@ void ImageDisplay::wheelEvent(QWheelEvent *event)
 void ImageDisplay::showConnectedComponents(const cv::Mat &stats,
                                            const cv::Mat &centroids)
 {
-    _ccCenters.clear();
-    _ccAreas.clear();
-
-    int n = stats.rows;  // number of components
-
-    for (int i = 1; i < n; i++)  // skip background (i=0)
-    {
-        double cx = centroids.at<double>(i, 0);
-        double cy = centroids.at<double>(i, 1);
-        int area = stats.at<int>(i, cv::CC_STAT_AREA);
-
-        _ccCenters.emplace_back(cx, cy);
-        _ccAreas.push_back(area);
-    }
+    // Same components as already shown: keep the index and cached labels
+    if (!_ccOverlay.isSameAs(stats))
+        _ccOverlay.set(stats, centroids);
 
     _drawCC = true;
     update();  // triggers paintEvent
@@ -368,9 +468,24 @@ cv::Mat ImageDisplay::getMaskFromTool() const{
     return mask;
 }
 
+void ImageDisplay::showTracks(const std::vector<Tracker::Track> &tracks)
+{
+    _trackOverlay.set(tracks);
+    _drawTracks = true;
+    update();
+}
+
+void ImageDisplay::hideTracks()
+{
+    _drawTracks = false;
+    _trackOverlay.clear();
+    update();
+}
+
 void ImageDisplay::showHoughCircles(const std::vector<cv::Vec3f>& circles)
 {
-    _circles = circles;
+    if (!_houghOverlay.isSameAs(circles))
+        _houghOverlay.set(circles);
     _drawHough = true;
     update();  // triggers paintEvent
 }
\ No newline at end of file
@@ -7,6 +7,12 @@
 #include <QVector>
 #include <opencv2/opencv.hpp>
 #include <QLabel>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <deque>
+#include "TilePyramid.h"
+#include "OverlayLayer.h"
+#include "RegionStats.h"
 
 
 enum leftClicToolType {DRAW_LINE, DRAW_CIRCLE, DRAW_RECT, NONE};
@@ -20,6 +26,10 @@ public:
 
     // Set image from cv::Mat
     void setImage(const cv::Mat &mat);
+    // Reduced image shown in place of a full one still loading, factor times smaller
+    void setPreview(const cv::Mat &mat, int factor);
+    // Display lut(gray), written straight into the displayed buffer
+    void setImageLut(const cv::Mat &gray, const cv::Mat &lut);
     QString getPixelValue(const QPoint &widgetPos) const;
     QString getPixelPosition(const QPoint &widgetPos) const;
     void setLabelLine() const;
@@ -32,6 +42,17 @@ public:
 
     cv::Mat getMaskFromTool() const;
 
+    // Performance and memory HUD, below the info labels
+    void setHudVisible(bool visible);
+    bool hudVisible() const { return hudLabel->isVisible(); }
+    // Latency of the last operation, from the user action to its result on screen
+    void setHudOperation(const QString &name, double ms);
+    // Memory held outside the display, in bytes
+    void setHudMemory(size_t original, size_t current, size_t undo);
+
+    void showTracks(const std::vector<Tracker::Track> &tracks);
+    void hideTracks();
+
     void showHoughCircles(const std::vector<cv::Vec3f>& circles);
     void hideHoughCircles(){
         _drawHough = false;
@@ -48,6 +69,9 @@ protected:
 
 private:
     QImage qimg;                 // Current image to display
+    TilePyramid *pyramid;        // Tiles of qimg actually drawn
+    cv::Mat lutBuffer;           // Owned buffer behind qimg for threshold previews
+    int previewFactor = 1;       // qimg is this many times smaller than the image it stands for
     double scale;                // Zoom factor
     QPoint panOffset;            // Current pan offset
     QPoint lastMousePos;         // Last mouse position for drag
@@ -55,6 +79,26 @@ private:
     QLabel *pixelLabel;
     QLabel *lineLabel;
     QLabel *lineLabel2;
+    QLabel *statsLabel;
+    QLabel *hudLabel;
+    QTimer *hudTimer;                // refreshes hudLabel, paints never touch it
+    QElapsedTimer paintClock;
+    std::deque<qint64> paintTimes;   // paints of the last second, in ms, for the frame rate
+    double lastPaintMs = 0;
+    QString hudOperation;
+    double hudOperationMs = 0;
+    size_t hudOriginal = 0;
+    size_t hudCurrent = 0;
+    size_t hudUndo = 0;
+    size_t qimgCopyBytes = 0;        // qimg bytes not shared with the cv::Mat it shows
+    void refreshHud();
+
+    // Gray level statistics under the rectangle and circle tools. The index is built
+    // on the first drag over a new image, drags then only query it.
+    cv::Mat statsSource;             // displayed image, empty for previews
+    mutable RegionStatsIndex regionStats;
+    const RegionStatsIndex &statsIndex() const;
+    void setLabelStats(const RegionStats &stats) const;
 
     bool leftDragging;           // Panning
     bool rightDragging;          // Drawing circle
@@ -64,14 +108,14 @@ private:
     double _mouseX;
     double _mouseY;
 
-    std::vector<QPointF> _ccCenters;
-    std::vector<int> _ccAreas;
+    ComponentOverlay _ccOverlay;
     bool _drawCC = false;
 
-    // Helpers
-    QImage matToQImage(const cv::Mat &mat);
-    std::vector<cv::Vec3f> _circles;
+    CircleOverlay _houghOverlay;
     bool _drawHough = false;
+
+    TrackOverlay _trackOverlay;
+    bool _drawTracks = false;
 };
 
 #endif // IMAGEDISPLAY_H
@@ -0,0 +1,295 @@
+#include "Kernels.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Roughly 64k pixels per stripe, enough to amortize the scheduling
+double stripesFor(const cv::Mat &m)
+{
+    return std::max(1.0, m.total() / 65536.0);
+}
+
+void maxChannelRow(const uchar *src, uchar *dst, int width)
+{
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 b, g, r;
+        cv::v_load_deinterleave(src + 3 * x, b, g, r);
+        cv::v_store(dst + x, cv::v_max(cv::v_max(b, g), r));
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar *p = src + 3 * x;
+        dst[x] = std::max(std::max(p[0], p[1]), p[2]);
+    }
+}
+
+// dst = (gray > t && mask) ? 255 : 0, mask may be null
+void thresholdRow(const uchar *gray, const uchar *mask, uchar *dst, int width, uchar t)
+{
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint8 vt = cv::vx_setall_u8(t);
+    const cv::v_uint8 zero = cv::vx_setzero_u8();
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 v = cv::v_gt(cv::vx_load(gray + x), vt);
+        if (mask)
+            v = cv::v_and(v, cv::v_ne(cv::vx_load(mask + x), zero));
+        cv::v_store(dst + x, v);
+    }
+#endif
+    for (; x < width; x++)
+        dst[x] = (gray[x] > t && (!mask || mask[x])) ? 255 : 0;
+}
+
+void maxChannelThresholdRow(const uchar *src, const uchar *mask, uchar *dst, int width, uchar t)
+{
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint8 vt = cv::vx_setall_u8(t);
+    const cv::v_uint8 zero = cv::vx_setzero_u8();
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 b, g, r;
+        cv::v_load_deinterleave(src + 3 * x, b, g, r);
+        cv::v_uint8 v = cv::v_gt(cv::v_max(cv::v_max(b, g), r), vt);
+        if (mask)
+            v = cv::v_and(v, cv::v_ne(cv::vx_load(mask + x), zero));
+        cv::v_store(dst + x, v);
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar *p = src + 3 * x;
+        uchar m = std::max(std::max(p[0], p[1]), p[2]);
+        dst[x] = (m > t && (!mask || mask[x])) ? 255 : 0;
+    }
+}
+
+void accumulateMeanRow(const uchar *src, float *mean, int width, float alpha)
+{
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 va = cv::vx_setall_f32(alpha);
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_float32 v = cv::v_cvt_f32(cv::v_reinterpret_as_s32(cv::vx_load_expand_q(src + x)));
+        cv::v_float32 m = cv::vx_load(mean + x);
+        cv::v_store(mean + x, cv::v_fma(cv::v_sub(v, m), va, m));
+    }
+#endif
+    for (; x < width; x++)
+        mean[x] += alpha * (src[x] - mean[x]);
+}
+
+void accumulateMedianRow(const uchar *src, uchar *median, int width)
+{
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint8 one = cv::vx_setall_u8(1);
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 v = cv::vx_load(src + x);
+        cv::v_uint8 m = cv::vx_load(median + x);
+        cv::v_uint8 up = cv::v_and(cv::v_gt(v, m), one);
+        cv::v_uint8 down = cv::v_and(cv::v_lt(v, m), one);
+        cv::v_store(median + x, cv::v_sub(cv::v_add(m, up), down));
+    }
+#endif
+    for (; x < width; x++)
+        median[x] += (src[x] > median[x]) - (src[x] < median[x]);
+}
+
+// Handles the thresholds cv::threshold treats specially on 8 bit images.
+// Returns false when the generic kernel has to run with the returned byte threshold.
+bool trivialThreshold(const cv::Size &size, double thresh, const cv::Mat &mask, cv::Mat &dst, uchar &t)
+{
+    int it = cvFloor(thresh);
+    if (it >= 255) {
+        dst = cv::Mat(size, CV_8UC1, cv::Scalar(0));
+        return true;
+    }
+    if (it < 0) {
+        // Everything passes, only the mask remains
+        cv::Mat out;
+        if (mask.empty())
+            out = cv::Mat(size, CV_8UC1, cv::Scalar(255));
+        else
+            cv::compare(mask, 0, out, cv::CMP_NE);
+        dst = out;
+        return true;
+    }
+    t = static_cast<uchar>(it);
+    return false;
+}
+
+// Same budget per stripe, counting the covered pixels only
+double stripesFor(const MaskRuns &runs)
+{
+    return std::max(1.0, runs.area / 65536.0);
+}
+
+// Calls row(y, span) for every span, rows split across threads
+template <typename RowFn>
+void forEachSpan(const MaskRuns &runs, RowFn &&row)
+{
+    const cv::Rect &b = runs.bounds;
+    cv::parallel_for_(cv::Range(b.y, b.y + b.height), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            for (const MaskRuns::Span *s = runs.rowBegin(y); s != runs.rowEnd(y); s++)
+                row(y, *s);
+    }, stripesFor(runs));
+}
+
+// Threshold given spans, after the trivial cases. Returns false when the kernel has to run.
+bool trivialThresholdRuns(const MaskRuns &runs, double thresh, cv::Mat &dst, uchar &t)
+{
+    int it = cvFloor(thresh);
+    if (it >= 0 && it < 255) {
+        t = static_cast<uchar>(it);
+        return false;
+    }
+    cv::Mat out(runs.size, CV_8UC1, cv::Scalar(0));
+    if (it < 0)
+        forEachSpan(runs, [&](int y, const MaskRuns::Span &s) {
+            std::fill(out.ptr<uchar>(y) + s.x0, out.ptr<uchar>(y) + s.x1, uchar(255));
+        });
+    dst = out;
+    return true;
+}
+
+} // namespace
+
+void maxChannelGray(const cv::Mat &src, cv::Mat &dst)
+{
+    if (src.channels() == 1) {
+        dst = src;
+        return;
+    }
+    CV_Assert(src.type() == CV_8UC3);
+
+    cv::Mat in = src;
+    cv::Mat out(in.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, in.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            maxChannelRow(in.ptr<uchar>(y), out.ptr<uchar>(y), in.cols);
+    }, stripesFor(in));
+    dst = out;
+}
+
+void thresholdMasked(const cv::Mat &gray, double thresh, const cv::Mat &mask, cv::Mat &dst)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == gray.size()));
+
+    cv::Mat in = gray;
+    uchar t = 0;
+    if (trivialThreshold(in.size(), thresh, mask, dst, t))
+        return;
+
+    cv::Mat out(in.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, in.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            thresholdRow(in.ptr<uchar>(y), mask.empty() ? nullptr : mask.ptr<uchar>(y),
+                         out.ptr<uchar>(y), in.cols, t);
+    }, stripesFor(in));
+    dst = out;
+}
+
+void maxChannelThresholdMasked(const cv::Mat &bgr, double thresh, const cv::Mat &mask, cv::Mat &dst)
+{
+    if (bgr.channels() == 1) {
+        thresholdMasked(bgr, thresh, mask, dst);
+        return;
+    }
+    CV_Assert(bgr.type() == CV_8UC3);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == bgr.size()));
+
+    cv::Mat in = bgr;
+    uchar t = 0;
+    if (trivialThreshold(in.size(), thresh, mask, dst, t))
+        return;
+
+    cv::Mat out(in.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, in.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            maxChannelThresholdRow(in.ptr<uchar>(y), mask.empty() ? nullptr : mask.ptr<uchar>(y),
+                                   out.ptr<uchar>(y), in.cols, t);
+    }, stripesFor(in));
+    dst = out;
+}
+
+void thresholdRuns(const cv::Mat &gray, double thresh, const MaskRuns &runs, cv::Mat &dst)
+{
+    CV_Assert(gray.type() == CV_8UC1 && gray.size() == runs.size);
+
+    cv::Mat in = gray;
+    uchar t = 0;
+    if (trivialThresholdRuns(runs, thresh, dst, t))
+        return;
+
+    cv::Mat out(in.size(), CV_8UC1, cv::Scalar(0));
+    forEachSpan(runs, [&](int y, const MaskRuns::Span &s) {
+        thresholdRow(in.ptr<uchar>(y) + s.x0, nullptr, out.ptr<uchar>(y) + s.x0, s.x1 - s.x0, t);
+    });
+    dst = out;
+}
+
+void maxChannelThresholdRuns(const cv::Mat &bgr, double thresh, const MaskRuns &runs, cv::Mat &dst)
+{
+    if (bgr.channels() == 1) {
+        thresholdRuns(bgr, thresh, runs, dst);
+        return;
+    }
+    CV_Assert(bgr.type() == CV_8UC3 && bgr.size() == runs.size);
+
+    cv::Mat in = bgr;
+    uchar t = 0;
+    if (trivialThresholdRuns(runs, thresh, dst, t))
+        return;
+
+    cv::Mat out(in.size(), CV_8UC1, cv::Scalar(0));
+    forEachSpan(runs, [&](int y, const MaskRuns::Span &s) {
+        maxChannelThresholdRow(in.ptr<uchar>(y) + 3 * s.x0, nullptr, out.ptr<uchar>(y) + s.x0,
+                               s.x1 - s.x0, t);
+    });
+    dst = out;
+}
+
+void copyRuns(const cv::Mat &src, const MaskRuns &runs, cv::Mat &dst)
+{
+    // Whole elements are copied, any type works, label maps included
+    CV_Assert(src.size() == runs.size);
+
+    cv::Mat in = src;
+    cv::Mat out(in.size(), in.type(), cv::Scalar::all(0));
+    const size_t pixel = in.elemSize();
+    forEachSpan(runs, [&](int y, const MaskRuns::Span &s) {
+        std::memcpy(out.ptr<uchar>(y) + s.x0 * pixel, in.ptr<uchar>(y) + s.x0 * pixel,
+                    (s.x1 - s.x0) * pixel);
+    });
+    dst = out;
+}
+
+void accumulateMean(const cv::Mat &gray, cv::Mat &mean, float alpha)
+{
+    CV_Assert(gray.type() == CV_8UC1 && mean.type() == CV_32FC1 && gray.size() == mean.size());
+    cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            accumulateMeanRow(gray.ptr<uchar>(y), mean.ptr<float>(y), gray.cols, alpha);
+    }, stripesFor(gray));
+}
+
+void accumulateMedian(const cv::Mat &gray, cv::Mat &median)
+{
+    CV_Assert(gray.type() == CV_8UC1 && median.type() == CV_8UC1 && gray.size() == median.size());
+    cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+            accumulateMedianRow(gray.ptr<uchar>(y), median.ptr<uchar>(y), gray.cols);
+    }, stripesFor(gray));
+}
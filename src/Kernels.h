@@ -0,0 +1,33 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <opencv2/core.hpp>
+#include "MaskRuns.h"
+
+// Vectorized (OpenCV universal intrinsics) and row-parallel image kernels.
+// Outputs are always written to freshly allocated or exclusively owned buffers.
+
+// Single channel image holding the max over B, G and R, single channel input is returned as is
+void maxChannelGray(const cv::Mat &src, cv::Mat &dst);
+
+// Same as cv::threshold(THRESH_BINARY, 255) followed by copyTo(dst, mask), in one pass.
+// The mask may be empty.
+void thresholdMasked(const cv::Mat &gray, double thresh, const cv::Mat &mask, cv::Mat &dst);
+
+// Max channel, threshold and mask fused: reads interleaved BGR once and writes the binary.
+void maxChannelThresholdMasked(const cv::Mat &bgr, double thresh, const cv::Mat &mask, cv::Mat &dst);
+
+// Run-length mask variants: only the spans inside runs.bounds are read, everything else
+// in dst is zero. dst has the full frame size.
+void thresholdRuns(const cv::Mat &gray, double thresh, const MaskRuns &runs, cv::Mat &dst);
+void maxChannelThresholdRuns(const cv::Mat &bgr, double thresh, const MaskRuns &runs, cv::Mat &dst);
+// Same as src.copyTo(dst, mask) for the mask the runs were built from, for any type
+void copyRuns(const cv::Mat &src, const MaskRuns &runs, cv::Mat &dst);
+
+// Background model updates, in place on a model buffer the caller owns exclusively.
+// Exponential running mean: mean += alpha * (gray - mean), mean is CV_32FC1.
+void accumulateMean(const cv::Mat &gray, cv::Mat &mean, float alpha);
+// Approximate running median: every pixel of median (CV_8UC1) moves one level toward gray.
+void accumulateMedian(const cv::Mat &gray, cv::Mat &median);
+
+#endif // KERNELS_H
@@ -8,14 +8,304 @@
 #include <QMessageBox>
 #include <QApplication>
 #include <QGroupBox>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QMenuBar>
+#include <QMenu>
+#include <QAction>
+#include <cmath>
+#include "Filters.h"
+#include "Kernels.h"
+#include "Histogram.h"
+#include "Components.h"
+#include "Detection.h"
+#include "Trace.h"
+#include "Background.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
+    _runner = new AsyncRunner(this);
+    _loader = new AsyncRunner(this);
+    _previewLoader = new AsyncRunner(this);
+    _bgLearner = new AsyncRunner(this);
+    _treeBuilder = new AsyncRunner(this);
+    _video = new VideoSource(this);
+    auto busyCursor = [](bool busy) {
+        // Busy cursor rather than wait cursor: the UI stays usable while a job runs
+        if (busy)
+            QApplication::setOverrideCursor(Qt::BusyCursor);
+        else
+            QApplication::restoreOverrideCursor();
+    };
+    connect(_runner, &AsyncRunner::busyChanged, this, busyCursor);
+    connect(_loader, &AsyncRunner::busyChanged, this, busyCursor);
+    connect(_bgLearner, &AsyncRunner::busyChanged, this, busyCursor);
+    connect(_treeBuilder, &AsyncRunner::busyChanged, this, busyCursor);
+    _setupPipeline();
     _setupUI();
+
+    QSettings settings("Pogoteam", "pogotrack_gui");
+    _history.setBudget(settings.value("history/budgetMB", 512).toULongLong() << 20);
+    // Detections survive the session, keyed by what they were computed from
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/results";
+    _resultCache.open(cacheDir.toStdString(), settings.value("cache/budgetMB", 256).toULongLong() << 20);
+}
+
+MainWindow::~MainWindow()
+{
+    // Jobs reach members such as the result cache through this: the runners, children
+    // destroyed after the members, are deleted first so they wait for their jobs
+    for (AsyncRunner *runner : {_runner, _loader, _previewLoader, _bgLearner, _treeBuilder})
+        delete runner;
+}
+
+void MainWindow::_setupPipeline()
+{
+    // Passes the frame through unless background subtraction is on
+    _foregroundStage     = _pipeline.addStage(std::make_unique<ForegroundFilter>());
+    _grayStage           = _pipeline.addStage(std::make_unique<MaxChannelFilter>(), _foregroundStage);
+    // Masking before a global threshold gives the same binary, and keeps the slider
+    // from redoing the mask on every tick
+    _maskedGrayStage     = _pipeline.addStage(std::make_unique<MaskFilter>(), _grayStage);
+    _thresholdStage      = _pipeline.addStage(std::make_unique<ThresholdFilter>(), _maskedGrayStage);
+    // The adaptative threshold looks at neighbours, so it has to see the unmasked image
+    _adaptiveStage       = _pipeline.addStage(std::make_unique<AdaptiveThresholdFilter>(), _grayStage);
+    _maskedAdaptiveStage = _pipeline.addStage(std::make_unique<MaskFilter>(), _adaptiveStage);
+    // Computed once per image and mask, drives the slider preview and the suggestions
+    _histogramStage      = _pipeline.addStage(std::make_unique<HistogramFilter>(), _grayStage);
+}
+
+void MainWindow::_setMask(const cv::Mat &mask)
+{
+    _currentMask = mask;
+    MaskFilter *maskStage = _pipeline.stage<MaskFilter>(_maskedGrayStage);
+    maskStage->setMask(mask);
+    _currentRuns = maskStage->runs();
+    // Every stage works on the mask bounds, or its spans, instead of the full frame
+    _pipeline.stage<MaskFilter>(_maskedAdaptiveStage)->shareMask(*maskStage);
+    _pipeline.stage<ThresholdFilter>(_thresholdStage)->setRegion(_currentRuns, maskStage->maskId());
+    _pipeline.stage<AdaptiveThresholdFilter>(_adaptiveStage)->setRegion(_currentRuns);
+    _pipeline.stage<HistogramFilter>(_histogramStage)->setRegion(_currentRuns, maskStage->maskId());
+}
+
+History::Command MainWindow::_thresholdRecipe(double thres) const
+{
+    std::shared_ptr<const MaskRuns> runs = _currentRuns;
+    cv::Mat background = _activeBackground();
+    return History::Command{QString("threshold %1").arg(thres), [thres, runs, background](const cv::Mat &input) {
+        cv::Mat binary;
+        if (runs && runs->size == input.size())
+            maxChannelThresholdRuns(subtractBackground(input, background), thres, *runs, binary);
+        else
+            maxChannelThresholdMasked(subtractBackground(input, background), thres, cv::Mat(), binary);
+        return binary;
+    }};
+}
+
+History::Command MainWindow::_adaptiveRecipe(const AdaptativeParams &params) const
+{
+    cv::Mat mask = _currentMask;
+    cv::Mat background = _activeBackground();
+    return History::Command{"adaptative threshold", [params, mask, background](const cv::Mat &input) {
+        MaxChannelFilter gray;
+        AdaptiveThresholdFilter adaptive;
+        adaptive.setParams(params);
+        MaskFilter masked;
+        masked.setMask(mask);
+        adaptive.setRegion(masked.runs());
+        return masked.apply(adaptive.apply(gray.apply(subtractBackground(input, background))));
+    }};
+}
+
+cv::Mat MainWindow::_activeBackground() const
+{
+    return _bgSubtract->isChecked() ? _background.background() : cv::Mat();
 }
 
-MainWindow::~MainWindow() {}
+void MainWindow::_showBase()
+{
+    // The frame, or its foreground: what every operation starts from
+    cv::Mat background = _activeBackground();
+    if (background.empty() || background.size() != _originalImage.size()) {
+        _currentImage = _originalImage;
+        _recipe = History::Command{"load", History::Replay()};
+    } else {
+        _currentImage = _pipeline.evaluate(_foregroundStage);
+        _recipe = History::Command{"foreground", [background](const cv::Mat &input) {
+            return subtractBackground(input, background);
+        }};
+    }
+}
+
+void MainWindow::_updateBackground()
+{
+    _bgStatus->setText(_background.empty() ? QString("No background")
+                                           : QString("Background from %1 frames").arg(_background.frames()));
+    _pipeline.stage<ForegroundFilter>(_foregroundStage)->setBackground(_activeBackground(), _background.id());
+}
+
+void MainWindow::_learnBackgroundFromVideo()
+{
+    if (_videoPath.isEmpty()) {
+        QMessageBox::information(this, "Background", "Open a video first");
+        return;
+    }
+    BackgroundModel::Mode mode = _background.mode();
+    float alpha = _background.alpha();
+    std::string path = _videoPath.toStdString();
+
+    _bgLearner->submit([this, path, mode, alpha](const AsyncRunner::CancelFlag &cancelled) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: learn background");
+        cv::VideoCapture capture(path);
+        if (!capture.isOpened()) return AsyncRunner::Completion();
+
+        // About 200 frames spread over the video, the skipped ones are grabbed but not decoded
+        BackgroundModel learned;
+        learned.setMode(mode);
+        learned.setAlpha(alpha);
+        int count = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+        int stride = std::max(1, count / 200);
+        cv::Mat frame;
+        for (int i = 0; !cancelled; i++) {
+            if (i % stride != 0) {
+                if (!capture.grab()) break;
+                continue;
+            }
+            if (!capture.read(frame)) break;
+            learned.update(frame);
+        }
+        if (cancelled || learned.empty()) return AsyncRunner::Completion();
+
+        return [this, learned]() {
+            _background = learned;
+            _updateBackground();
+            if (_bgSubtract->isChecked() && !_originalImage.empty()) {
+                _runner->cancel();
+                _showBase();
+                _currentOverlays = 0;
+                _displayImage();
+                _updateHistogram();
+            }
+        };
+    });
+}
+
+void MainWindow::_updateTracks()
+{
+    if (!_trackCheck->isChecked()) return;
+    TRACE_SCOPE("MainWindow::_updateTracks");
+
+    // Circles when detected, component centroids otherwise
+    std::vector<cv::Point2f> detections;
+    if (_currentOverlays & HOUGH_CIRCLES) {
+        detections.reserve(_HoughCircles.size());
+        for (const cv::Vec3f &c : _HoughCircles)
+            detections.emplace_back(c[0], c[1]);
+    } else if ((_currentOverlays & CONNECTED_COMPONENTS) && !_cccentroids.empty()) {
+        detections.reserve(_cccentroids.rows);
+        for (int i = 1; i < _cccentroids.rows; i++)  // skip background (i=0)
+            detections.emplace_back(_cccentroids.at<double>(i, 0), _cccentroids.at<double>(i, 1));
+    } else {
+        return;
+    }
+    // A robot moves less than its radius between two frames
+    _tracker.setMaxDistance(_params.maxRadius > 0 ? _params.maxRadius : 50);
+    _tracker.update(_frameIndex, detections);
+}
+
+void MainWindow::_updateHistogram()
+{
+    TRACE_SCOPE("MainWindow::_updateHistogram");
+    if (_originalImage.empty()) {
+        _histogram->clear();
+        _buildComponentTree();
+        return;
+    }
+    cv::Mat hist = _pipeline.evaluate(_histogramStage);
+    _otsuSuggestion = otsuThreshold(hist);
+    _triangleSuggestion = triangleThreshold(hist);
+
+    _histogram->setHistogram(hist);
+    _histogram->setSuggestions(_otsuSuggestion, _triangleSuggestion);
+    _otsuBtn->setText(QString("Otsu: %1").arg(_otsuSuggestion));
+    _triangleBtn->setText(QString("Triangle: %1").arg(_triangleSuggestion));
+    _buildComponentTree();
+}
+
+void MainWindow::_buildComponentTree()
+{
+    _treeBuilder->cancel();
+    _componentTree.clear();
+    _treeSource = cv::Mat();
+    _histogram->setCounts({}, {});
+    if (!_ccLive->isChecked() || _originalImage.empty()) return;
+
+    // Same image the threshold stage reads, zero outside the mask
+    cv::Mat gray = _pipeline.evaluate(_maskedGrayStage);
+    if (gray.type() != CV_8UC1) return;
+    _treeBuilder->submit([this, gray](const AsyncRunner::CancelFlag &cancelled) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: component tree");
+        cv::TickMeter tm;
+        tm.start();
+        auto tree = std::make_shared<ComponentTree>();
+        if (!tree->build(gray, &cancelled)) return AsyncRunner::Completion();
+        tm.stop();
+        double ms = tm.getTimeMilli();
+
+        return [this, gray, tree, ms]() {
+            _componentTree = std::move(*tree);
+            _treeSource = gray;
+            _updateComponentCounts();
+            int threshold = _binThreshold->value();
+            _ccTiming->setText(QString("Component tree: %1 nodes, %2 MB in %3 ms - %4 components at threshold %5")
+                               .arg(_componentTree.nodeCount())
+                               .arg(_componentTree.bytes() / double(1 << 20), 0, 'f', 1)
+                               .arg(ms, 0, 'f', 1)
+                               .arg(_componentTree.counts()[threshold])
+                               .arg(threshold));
+        };
+    });
+}
+
+void MainWindow::_updateComponentCounts()
+{
+    if (_componentTree.empty()) return;
+    // Robots are the components with the area of a disc of minRadius..maxRadius
+    std::vector<int> robots;
+    if (_params.maxRadius > 0) {
+        int minArea = static_cast<int>(CV_PI * _params.minRadius * _params.minRadius);
+        int maxArea = static_cast<int>(std::ceil(CV_PI * _params.maxRadius * _params.maxRadius));
+        robots = _componentTree.counts(minArea, maxArea);
+    }
+    _histogram->setCounts(_componentTree.counts(), robots);
+}
+
+bool MainWindow::_showTreeComponents(int threshold, bool keep)
+{
+    // The tree may still be building, or belong to the image before a mask or frame change
+    if (!_ccLive->isChecked() || _componentTree.empty()
+        || _treeSource.data != _pipeline.evaluate(_maskedGrayStage).data)
+        return false;
+    TRACE_SCOPE("MainWindow::_showTreeComponents");
+    cv::TickMeter tm;
+    tm.start();
+    cv::Mat stats, centroids;
+    int count = _componentTree.components(threshold, stats, centroids);
+    tm.stop();
+    _ccTiming->setText(QString("%1 components at threshold %2 - component tree %3 ms")
+                       .arg(count - 1)
+                       .arg(threshold)
+                       .arg(tm.getTimeMilli(), 0, 'f', 1));
+
+    _display->showConnectedComponents(stats, centroids);
+    if (keep) {
+        _currentOverlays |= CONNECTED_COMPONENTS;
+        _ccstats = stats;
+        _cccentroids = centroids;
+    }
+    return true;
+}
 
 void MainWindow::_setupUI()
 {
@@ -32,13 +322,23 @@ void MainWindow::_setupUI()
     _sideLayout = new QVBoxLayout;
 
     QPushButton *browse         = new QPushButton("Open test image");
+    QPushButton *browseVideo    = new QPushButton("Open video");
+    QPushButton *saveParamsBtn  = new QPushButton("Save parameters");
+    QPushButton *loadParamsBtn  = new QPushButton("Load parameters");
     QRadioButton *lineToolBtn   = new QRadioButton("Line");
     QRadioButton *rectToolBtn   = new QRadioButton("Rectangle");
     QRadioButton *circToolBtn   = new QRadioButton("Circle");
     QPushButton *applyMaskBtn   = new QPushButton("Apply Mask");
+    QPushButton *addMaskBtn     = new QPushButton("Add to mask");
+    QPushButton *subMaskBtn     = new QPushButton("Subtract from mask");
     QPushButton *resetBtn       = new QPushButton("Reset");
     QPushButton *ccBtn          = new QPushButton("Connected Components");
+    _ccAlgorithm                = new QComboBox;
+    _ccLabelMap                 = new QCheckBox("Show label map");
+    _ccTiming                   = new QLabel;
+    _ccLive                     = new QCheckBox("Live components while thresholding");
     QPushButton *houghBtn       = new QPushButton("Hough Circles");
+    QPushButton *sweepBtn       = new QPushButton("Sweep param1 / param2");
     QPushButton *adaptBtn       = new QPushButton("Adaptative Threshold");
 
     dpEdit                     = new QLineEdit("1.0");
@@ -47,6 +347,7 @@ void MainWindow::_setupUI()
     param2Edit                 = new QLineEdit("14");
     minRadiusEdit              = new QLineEdit("40");
     maxRadiusEdit              = new QLineEdit("60");
+    minCircularityEdit         = new QLineEdit("0.7");
 
     meanCBtn                   = new QRadioButton("Mean C");
     gaussianCBtn               = new QRadioButton("Gaussian C");
@@ -59,12 +360,28 @@ void MainWindow::_setupUI()
     _binThreshold->setValue(255);
     _binThreshold->setSingleStep(1.0);  // optional
 
+    _histogram                 = new HistogramWidget(this);
+    _otsuBtn                   = new QPushButton("Otsu");
+    _triangleBtn               = new QPushButton("Triangle");
+
     // ---- Import ----
     QLabel *importLabel = new QLabel("Import");
     importLabel->setStyleSheet("font-weight: bold; font-size: 14px;");
     _sideLayout->addWidget(importLabel);
 
     _sideLayout->addWidget(browse);
+    _sideLayout->addWidget(browseVideo);
+    _frameLabel = new QLabel;
+    _timeline = new QSlider(Qt::Horizontal);
+    _timeline->setRange(0, 0);
+    _frameLabel->hide();
+    _timeline->hide();
+    _sideLayout->addWidget(_frameLabel);
+    _sideLayout->addWidget(_timeline);
+    QHBoxLayout *paramsLayout = new QHBoxLayout();
+    paramsLayout->addWidget(saveParamsBtn);
+    paramsLayout->addWidget(loadParamsBtn);
+    _sideLayout->addLayout(paramsLayout);
     _sideLayout->addSpacing(8);   // Space after category
 
     // ---- Tools ----
@@ -83,6 +400,10 @@ void MainWindow::_setupUI()
     _sideLayout->addWidget(rectToolBtn);
     _sideLayout->addWidget(circToolBtn);
     _sideLayout->addWidget(applyMaskBtn);
+    QHBoxLayout *combineLayout = new QHBoxLayout();
+    combineLayout->addWidget(addMaskBtn);
+    combineLayout->addWidget(subMaskBtn);
+    _sideLayout->addLayout(combineLayout);
     _sideLayout->addSpacing(8);
 
     // ---- Operations ----
@@ -93,13 +414,41 @@ void MainWindow::_setupUI()
     _threshValueLabel = new QLabel("Threshold : 255");
 
     _sideLayout->addWidget(_threshValueLabel);
+    _sideLayout->addWidget(_histogram);
     _sideLayout->addWidget(_binThreshold);
+    QHBoxLayout *suggestLayout = new QHBoxLayout();
+    suggestLayout->addWidget(_otsuBtn);
+    suggestLayout->addWidget(_triangleBtn);
+    _sideLayout->addLayout(suggestLayout);
     _sideLayout->addWidget(ccBtn);
+    // Spaghetti and BBDT label in parallel
+    _ccAlgorithm->addItem("Spaghetti", cv::CCL_SPAGHETTI);
+    _ccAlgorithm->addItem("BBDT", cv::CCL_BBDT);
+    _ccAlgorithm->addItem("SAUF", cv::CCL_SAUF);
+    _ccAlgorithm->addItem("Default", cv::CCL_DEFAULT);
+    _ccLabelMap->setToolTip("Display the label map itself instead of colored components");
+    _ccLive->setToolTip("Builds the component tree of the masked image once: component counts for every "
+                        "threshold are drawn over the histogram, and the slider shows its components "
+                        "without labeling again");
+    _ccTiming->setStyleSheet("font-size: 10px;");
+    _ccTiming->setWordWrap(true);
+    _sideLayout->addWidget(_ccAlgorithm);
+    _sideLayout->addWidget(_ccLabelMap);
+    _sideLayout->addWidget(_ccLive);
+    _sideLayout->addWidget(_ccTiming);
 
     QGroupBox *houghGroup = new QGroupBox(this);
     QVBoxLayout *houghVbox = new QVBoxLayout;
 
     houghVbox->addWidget(houghBtn);
+    // Robots all have about the same size: the annulus detector only searches that band
+    _circleDetector = new QComboBox;
+    _circleDetector->addItem("Hough gradient", HOUGH_GRADIENT_DETECTOR);
+    _circleDetector->addItem("Annulus (fixed size)", ANNULUS_DETECTOR);
+    _circleDetector->addItem("Blobs (binary image)", BLOB_DETECTOR);
+    _circleDetector->setToolTip("Annulus: correlation with a ring of minRadius..maxRadius, "
+                                "faster on a narrow band. param1 and param2 keep their Hough meaning");
+    houghVbox->addWidget(_circleDetector);
     // Helper lambda to add a label and input on the same line
     auto addLabelAndInputHough = [&](const QString &text, QLineEdit *edit) {
         QHBoxLayout *hLayout = new QHBoxLayout();
@@ -117,6 +466,29 @@ void MainWindow::_setupUI()
     addLabelAndInputHough("param2:", param2Edit);
     addLabelAndInputHough("minRadius:", minRadiusEdit);
     addLabelAndInputHough("maxRadius:", maxRadiusEdit);
+    addLabelAndInputHough("minCircularity:", minCircularityEdit);
+    minCircularityEdit->setToolTip("Blob detector only: 4 pi area / perimeter^2, 1 for a perfect disc");
+    // Last run of every detector, to compare them on the same frame
+    _detectorTiming = new QLabel;
+    _detectorTiming->setStyleSheet("font-size: 10px;");
+    _detectorTiming->setWordWrap(true);
+    houghVbox->addWidget(_detectorTiming);
+    _trackCheck = new QCheckBox("Track across frames");
+    _trackCheck->setToolTip("Links detections from frame to frame, gated by maxRadius");
+    houghVbox->addWidget(_trackCheck);
+    // Sweep heatmap, shown once a sweep has run
+    _sweep = new SweepWidget(this);
+    _sweep->hide();
+    _sweepExpected = new QSpinBox;
+    _sweepExpected->setRange(0, 100000);
+    _sweepExpected->setSpecialValueText("none");
+    _sweepExpected->setToolTip("Expected number of robots, the heatmap then shows the error");
+    houghVbox->addWidget(sweepBtn);
+    QHBoxLayout *expectedLayout = new QHBoxLayout();
+    expectedLayout->addWidget(new QLabel("Expected:"));
+    expectedLayout->addWidget(_sweepExpected);
+    houghVbox->addLayout(expectedLayout);
+    houghVbox->addWidget(_sweep);
     _sideLayout->addWidget(houghGroup);
 
     QGroupBox *adaptativeGroup = new QGroupBox(this);
@@ -142,6 +514,29 @@ void MainWindow::_setupUI()
     addLabelAndInputAdaptative("Block size:", adaptBlockSizeEdit);
     _sideLayout->addWidget(adaptativeGroup);
 
+    // Background model, learned over video frames or successive images
+    QGroupBox *backgroundGroup = new QGroupBox(this);
+    QVBoxLayout *backgroundVBox = new QVBoxLayout;
+    _bgMode = new QComboBox;
+    _bgMode->addItem("Running median", BackgroundModel::APPROXIMATE_MEDIAN);
+    _bgMode->addItem("Running mean", BackgroundModel::EXPONENTIAL_MEAN);
+    _bgLearn = new QCheckBox("Learn from shown frames");
+    _bgSubtract = new QCheckBox("Subtract background");
+    _bgStatus = new QLabel("No background");
+    _bgStatus->setStyleSheet("font-size: 10px;");
+    QPushButton *bgLearnVideoBtn = new QPushButton("Learn from video");
+    QPushButton *bgResetBtn = new QPushButton("Reset background");
+    backgroundVBox->addWidget(_bgMode);
+    backgroundVBox->addWidget(_bgLearn);
+    QHBoxLayout *bgButtons = new QHBoxLayout();
+    bgButtons->addWidget(bgLearnVideoBtn);
+    bgButtons->addWidget(bgResetBtn);
+    backgroundVBox->addLayout(bgButtons);
+    backgroundVBox->addWidget(_bgSubtract);
+    backgroundVBox->addWidget(_bgStatus);
+    backgroundGroup->setLayout(backgroundVBox);
+    _sideLayout->addWidget(backgroundGroup);
+
     _sideLayout->addWidget(resetBtn);
 
     // ---- Licencing ----
@@ -175,11 +570,34 @@ void MainWindow::_setupUI()
 
     // ---- Connect buttons ----
     connect(browse, &QPushButton::clicked, this, &MainWindow::_loadImage);
+    connect(browseVideo, &QPushButton::clicked, this, &MainWindow::_loadVideo);
+    connect(saveParamsBtn, &QPushButton::clicked, this, &MainWindow::_saveParams);
+    connect(loadParamsBtn, &QPushButton::clicked, this, &MainWindow::_loadParams);
+    connect(_timeline, &QSlider::valueChanged, this, [=](int frame) {
+        _frameLabel->setText(QString("Frame %1 / %2").arg(frame).arg(_video->frameCount() - 1));
+        _video->requestFrame(frame);
+    });
+    connect(_video, &VideoSource::frameReady, this, &MainWindow::_setFrame);
+    connect(_video, &VideoSource::frameCountChanged, this, [=](int count) {
+        _timeline->setMaximum(std::max(0, count - 1));
+        _frameLabel->setText(QString("Frame %1 / %2").arg(_timeline->value()).arg(count - 1));
+    });
     connect(_binThreshold, &QSlider::valueChanged, this, &MainWindow::applyThreshold);
     connect(_binThreshold, &QSlider::sliderReleased, this, &MainWindow::validateThreshold);
     connect(resetBtn, &QPushButton::clicked, this, &MainWindow::resetImage);
+    auto pickThreshold = [=](int value) {
+        if (value < 0 || _currentImage.empty()) return;
+        _binThreshold->setValue(value);
+        validateThreshold();
+    };
+    connect(_histogram, &HistogramWidget::thresholdPicked, this, pickThreshold);
+    connect(_otsuBtn, &QPushButton::clicked, this, [=]() { pickThreshold(_otsuSuggestion); });
+    connect(_triangleBtn, &QPushButton::clicked, this, [=]() { pickThreshold(_triangleSuggestion); });
     connect(ccBtn, &QPushButton::clicked, this, &MainWindow::connectedComponentsMode);
+    connect(_ccLive, &QCheckBox::toggled, this, &MainWindow::_buildComponentTree);
     connect(applyMaskBtn, &QPushButton::clicked, this, &MainWindow::applyMask);
+    connect(addMaskBtn, &QPushButton::clicked, this, &MainWindow::addToMask);
+    connect(subMaskBtn, &QPushButton::clicked, this, &MainWindow::subtractFromMask);
 
     connect(toolGroup, &QButtonGroup::idClicked, this, [=](int id) {
         if (toolGroup->button(id) == lineToolBtn) {
@@ -192,14 +610,49 @@ void MainWindow::_setupUI()
         }
     });
     connect(houghBtn, &QPushButton::clicked, this, &MainWindow::applyHoughCircles);
+    connect(sweepBtn, &QPushButton::clicked, this, &MainWindow::_sweepHough);
+    connect(_trackCheck, &QCheckBox::toggled, this, [=](bool on) {
+        _tracker.reset();
+        if (!on) _display->hideTracks();
+    });
+    connect(_sweepExpected, &QSpinBox::valueChanged, _sweep, &SweepWidget::setExpected);
+    connect(_sweepExpected, &QSpinBox::valueChanged, _histogram, &HistogramWidget::setExpectedCount);
+    connect(_sweep, &SweepWidget::paramsPicked, this, [=](double param1, double param2) {
+        param1Edit->setText(QString::number(param1));
+        param2Edit->setText(QString::number(param2));
+        getHoughParams();
+        _sweep->setCurrent(param1, param2);
+        _detectCircles(false);
+    });
     connect(dpEdit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
     connect(minDistEdit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
     connect(param1Edit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
     connect(param2Edit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
     connect(minRadiusEdit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
     connect(maxRadiusEdit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
+    connect(minCircularityEdit, &QLineEdit::editingFinished, this, &MainWindow::getHoughParams);
 
     connect(adaptBtn, &QPushButton::clicked, this, &MainWindow::applyAdaptativeThreshold);
+    connect(_bgMode, &QComboBox::currentIndexChanged, this, [=]() {
+        _background.setMode(static_cast<BackgroundModel::Mode>(_bgMode->currentData().toInt()));
+        _updateBackground();
+    });
+    connect(bgLearnVideoBtn, &QPushButton::clicked, this, &MainWindow::_learnBackgroundFromVideo);
+    connect(bgResetBtn, &QPushButton::clicked, this, [=]() {
+        _bgLearner->cancel();
+        _background.reset();
+        _updateBackground();
+    });
+    connect(_bgSubtract, &QCheckBox::toggled, this, [=]() {
+        _updateBackground();
+        if (_originalImage.empty()) return;
+        // Start over from the frame or its foreground, the mask stays
+        _runner->cancel();
+        _showBase();
+        _currentOverlays = 0;
+        _displayImage();
+        _updateHistogram();
+    });
     connect(adaptMethodGroup, &QButtonGroup::idClicked, this, [=](int id) {
         if (adaptMethodGroup->button(id) == meanCBtn ) {
             _adaptParams.method = MEAN_C;
@@ -208,56 +661,279 @@ void MainWindow::_setupUI()
         }
     });
 
+    // ---- Diagnostics ----
+    QMenu *diagnosticsMenu = menuBar()->addMenu("Diagnostics");
+    QAction *recordTrace = diagnosticsMenu->addAction("Record trace");
+    recordTrace->setCheckable(true);
+    recordTrace->setChecked(trace::enabled());
+    connect(recordTrace, &QAction::toggled, this, [](bool on) {
+        if (on) trace::clear();   // a new recording starts empty
+        trace::setEnabled(on);
+    });
+    QAction *showHud = diagnosticsMenu->addAction("Show performance HUD");
+    showHud->setCheckable(true);
+    connect(showHud, &QAction::toggled, this, [=](bool on) {
+        _display->setHudVisible(on);
+        _updateHud();
+    });
+    QAction *exportTrace = diagnosticsMenu->addAction("Export trace...");
+    connect(exportTrace, &QAction::triggered, this, [=]() {
+        QString path =
+        QFileDialog::getSaveFileName(this, "Export trace", "pogotrack_trace.json",
+            "Chrome trace (*.json);");
+        if (path.isEmpty()) return;
+        if (!trace::exportJson(path.toStdString()))
+            QMessageBox::critical(this, "Trace Error", QString("Could not write %1").arg(path));
+    });
+    QAction *clearCache = diagnosticsMenu->addAction("Clear result cache");
+    connect(clearCache, &QAction::triggered, this, [=]() { _resultCache.clear(); });
+
     // ---- Shortcuts ----
     QShortcut *undoShortcut = new QShortcut(QKeySequence(QKeySequence::Undo), this);
     connect(undoShortcut, &QShortcut::activated, this, [=]() {
-        if (_stackIndex > 0) {
-            _stackIndex--;
-            _currentImage = _displayedImageStack[_stackIndex];
-            _currentOverlays = _overlayStack[_stackIndex];
-            _displayImage(false);
-        }
+        if (_history.canUndo())
+            _restoreState(_history.undo());
     });
     QShortcut *redoShortcut = new QShortcut(QKeySequence(QKeySequence::Redo), this);
     connect(redoShortcut, &QShortcut::activated, this, [=]() {
-        if (_stackIndex + 1 < static_cast<int>(_displayedImageStack.size())) {
-            _stackIndex++;
-            _currentImage = _displayedImageStack[_stackIndex];
-            _currentOverlays = _overlayStack[_stackIndex];
-            _displayImage(false);
-        }
+        if (_history.canRedo())
+            _restoreState(_history.redo());
     });
 
 }
 
 void MainWindow::_loadImage()
 {
+    TRACE_SCOPE("MainWindow::_loadImage");
     QString path =
     QFileDialog::getOpenFileName(this, "Open a file", ".",
-        "Images (*.png *.bmp *.jpg);");
+        "Images (*.png *.bmp *.jpg *.jpeg *.tif *.tiff);");
+    openImage(path);
+}
+
+void MainWindow::openImage(const QString &path)
+{
+    TRACE_SCOPE("MainWindow::openImage");
+    if (path.isEmpty()) return;
+
+    _startOperation("load image");
+    _runner->cancel();
+    _video->close();
+    _timeline->hide();
+    _frameLabel->hide();
+    _sweep->hide();   // swept on another image
+    _videoPath.clear();
+    _loading = true;
+
+    // Both decodes run at once: JPEG scales down while decoding so its preview comes
+    // first, for other formats the full image usually wins and the preview is dropped
+    std::string file = path.toStdString();
+    _previewLoader->submit([this, file](const AsyncRunner::CancelFlag &) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: load preview");
+        cv::Mat preview = cv::imread(file, cv::IMREAD_REDUCED_COLOR_4);
+        if (preview.empty()) return AsyncRunner::Completion();
+        return [this, preview]() {
+            if (_loading)
+                _display->setPreview(preview, 4);
+        };
+    });
+    _loader->submit([this, file](const AsyncRunner::CancelFlag &) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: load image");
+        cv::Mat image = cv::imread(file);
+        return [this, image]() { _imageLoaded(image); };
+    });
+}
 
-    _originalImage = cv::imread(path.toStdString());
+void MainWindow::_imageLoaded(const cv::Mat &image)
+{
+    TRACE_SCOPE("MainWindow::_imageLoaded");
+    _loading = false;
+    _previewLoader->cancel();
+    _frameIndex++;   // successive images track like video frames
+    _originalImage = image;
     if (_originalImage.empty())
         _originalImage = cv::Mat::zeros(480, 640, CV_8UC3);
+    _pipeline.setSource(_originalImage);
+    _history.clear(_originalImage);
+
+    if (_bgLearn->isChecked()) {
+        _background.update(_originalImage);
+        _updateBackground();
+    }
+
+    // Shared with the original: operations never write into their input
+    _showBase();
+    _displayImage();
+    _updateHistogram();
+
+    // Operations asked for while loading run on the new image, in order
+    std::vector<std::pair<QString, std::function<void()>>> pending;
+    pending.swap(_pendingOps);
+    for (const auto &op : pending)
+        op.second();
+}
+
+bool MainWindow::_deferWhileLoading(const QString &name, const std::function<void()> &op)
+{
+    if (!_loading) return false;
+    // A newer request of the same operation replaces the queued one
+    auto it = std::find_if(_pendingOps.begin(), _pendingOps.end(),
+                           [&name](const auto &pending) { return pending.first == name; });
+    if (it != _pendingOps.end())
+        it->second = op;
+    else
+        _pendingOps.emplace_back(name, op);
+    return true;
+}
+
+void MainWindow::_loadVideo()
+{
+    TRACE_SCOPE("MainWindow::_loadVideo");
+    QString path =
+    QFileDialog::getOpenFileName(this, "Open a video", ".",
+        "Videos (*.mp4 *.avi *.mkv *.mov);");
+    if (path.isEmpty()) return;
+
+    _runner->cancel();
+    // A video replaces an image still loading
+    _loader->cancel();
+    _previewLoader->cancel();
+    _loading = false;
+    _pendingOps.clear();
+    if (!_video->open(path)) {
+        QMessageBox::critical(this, "Video Error", QString("Could not open %1").arg(path));
+        return;
+    }
+    _videoPath = path;
+
+    _timeline->blockSignals(true);
+    _timeline->setRange(0, std::max(0, _video->frameCount() - 1));
+    _timeline->setValue(0);
+    _timeline->blockSignals(false);
+    _frameLabel->setText(QString("Frame 0 / %1").arg(_video->frameCount() - 1));
+    _timeline->show();
+    _frameLabel->show();
+
+    // Start from the raw frame, the first one is shown as soon as it is decoded
+    _recipe = History::Command{"load", History::Replay()};
+    _currentOverlays = 0;
+    _video->requestFrame(0);
+}
+
+void MainWindow::_saveParams()
+{
+    TRACE_SCOPE("MainWindow::_saveParams");
+    QString path =
+    QFileDialog::getSaveFileName(this, "Save parameters", "params.yml",
+        "Parameters (*.yml *.yaml *.json);");
+    if (path.isEmpty()) return;
+
+    getHoughParams();
+    ParamSet params;
+    params.binarization = _binarization;
+    params.threshold = _binThreshold->value();
+    params.adaptative = _adaptParams;
+    params.adaptative.blockSize = adaptBlockSizeEdit->text().toInt();
+    params.adaptative.C = adaptCEdit->text().toDouble();
+    params.hough = _params;
+    params.detector = static_cast<circleDetector>(_circleDetector->currentData().toInt());
+    params.mask = _currentMask;
+    if (!params.save(path.toStdString()))
+        QMessageBox::critical(this, "Parameters Error", QString("Could not write %1").arg(path));
+}
+
+void MainWindow::_loadParams()
+{
+    TRACE_SCOPE("MainWindow::_loadParams");
+    QString path =
+    QFileDialog::getOpenFileName(this, "Load parameters", ".",
+        "Parameters (*.yml *.yaml *.json);");
+    if (path.isEmpty()) return;
+
+    ParamSet params;
+    if (!params.load(path.toStdString())) {
+        QMessageBox::critical(this, "Parameters Error", QString("Could not read %1").arg(path));
+        return;
+    }
+
+    _params = params.hough;
+    dpEdit->setText(QString::number(_params.dp));
+    minDistEdit->setText(QString::number(_params.minDist));
+    param1Edit->setText(QString::number(_params.param1));
+    param2Edit->setText(QString::number(_params.param2));
+    minRadiusEdit->setText(QString::number(_params.minRadius));
+    maxRadiusEdit->setText(QString::number(_params.maxRadius));
+    minCircularityEdit->setText(QString::number(_params.minCircularity));
+    _circleDetector->setCurrentIndex(_circleDetector->findData(params.detector));
+
+    _adaptParams = params.adaptative;
+    adaptBlockSizeEdit->setText(QString::number(_adaptParams.blockSize));
+    adaptCEdit->setText(QString::number(_adaptParams.C));
+    (_adaptParams.method == MEAN_C ? meanCBtn : gaussianCBtn)->setChecked(true);
+
+    _binThreshold->blockSignals(true);
+    _binThreshold->setValue((int)params.threshold);
+    _binThreshold->blockSignals(false);
+    _threshValueLabel->setText("Threshold : " + QString::number((int)params.threshold));
+    _histogram->setThreshold((int)params.threshold);
+
+    if (_originalImage.empty()) {
+        _currentMask = params.mask;
+        _binarization = params.binarization;
+        return;
+    }
+    // A mask drawn on frames of another size does not apply here
+    _setMask(params.mask.size() == _originalImage.size() ? params.mask : cv::Mat());
+    _updateHistogram();
+    if (params.binarization == ParamSet::ADAPTATIVE_THRESHOLD)
+        applyAdaptativeThreshold();
+    else
+        validateThreshold();
+}
+
+void MainWindow::_setFrame(int index, const cv::Mat &frame)
+{
+    TRACE_SCOPE("MainWindow::_setFrame");
+    if (frame.empty()) return;
+    _frameIndex = index;
+    _startOperation("frame");
+    bool firstFrame = _originalImage.empty() || frame.size() != _originalImage.size();
+
+    _originalImage = frame;
+    _pipeline.setSource(_originalImage);
+    _history.clear(_originalImage);
+    if (firstFrame)
+        _setMask(cv::Mat());
+    // Operations keep the background they started with, the next ones see the updated one
+    if (_bgLearn->isChecked()) {
+        _background.update(frame);
+        _updateBackground();
+    }
 
-    _currentImage = _originalImage.clone();
+    // Re-run the current pipeline on the new frame
+    uint8_t overlays = _currentOverlays;
+    _currentOverlays = 0;
+    _currentImage = _recipe.run(_originalImage);
     _displayImage();
+    _updateHistogram();
+
+    // Detections are redone on the new frame too
+    if (overlays & CONNECTED_COMPONENTS)
+        connectedComponentsMode();
+    if (overlays & HOUGH_CIRCLES)
+        _detectCircles(false);
 }
 
 void MainWindow::_displayImage(bool addToStack)
 {
-    _displayImage(_currentImage, addToStack);
+    _displayImage(_currentImage, _recipe, addToStack);
 }
 
 
-void MainWindow::_displayImage(cv::Mat img, bool addToStack)
+void MainWindow::_displayImage(cv::Mat img, const History::Command &recipe, bool addToStack)
 {
+    TRACE_SCOPE("MainWindow::_displayImage");
     if(img.empty()) return;
-    cv::Mat rgb;
-    if (img.channels() == 1)
-        cv::cvtColor(img, rgb, cv::COLOR_GRAY2RGB);
-    else
-        cv::cvtColor(img, rgb, cv::COLOR_BGR2RGB);
 
     if(_currentOverlays & CONNECTED_COMPONENTS)
         _display->showConnectedComponents(_ccstats, _cccentroids);
@@ -267,203 +943,415 @@ void MainWindow::_displayImage(cv::Mat img, bool addToStack)
         _display->showHoughCircles(_HoughCircles);
     else
         _display->hideHoughCircles();
+    if(_trackCheck->isChecked())
+        _display->showTracks(_tracker.tracks());
+    else
+        _display->hideTracks();
 
     _display->setImage(img);
-    if(!addToStack) return;
-    _stackIndex++;
-    // Store in stack
-    if(_stackIndex < static_cast<int>(_displayedImageStack.size())){
-        _displayedImageStack[_stackIndex] = img.clone();
-        _overlayStack[_stackIndex] = _currentOverlays;
-        // Remove any redo history
-        _displayedImageStack.resize(_stackIndex + 1);
-        _overlayStack.resize(_stackIndex + 1);
-        printf("Resized stack to %zu\n", _displayedImageStack.size());
-    } else {
-        _displayedImageStack.push_back(img.clone());
-        _overlayStack.push_back(_currentOverlays);
+    if(addToStack) {
+        // Store in history, the image buffer is shared rather than copied
+        History::State state;
+        state.image = img;
+        state.overlays = _currentOverlays;
+        state.ccstats = _ccstats;
+        state.cccentroids = _cccentroids;
+        state.circles = _HoughCircles;
+        _history.push(recipe, state);
     }
+    _updateHud();
+}
+
+void MainWindow::_startOperation(const QString &name)
+{
+    _operation = name;
+    _operationClock.start();
+}
+
+void MainWindow::_updateHud()
+{
+    // Latency as the user sees it: from the action to its result on screen
+    if (_operationClock.isValid()) {
+        _display->setHudOperation(_operation, _operationClock.nsecsElapsed() / 1e6);
+        _operationClock.invalidate();
+    }
+    if (!_display->hudVisible()) return;
+    auto bytes = [](const cv::Mat &m) { return m.empty() ? size_t(0) : static_cast<size_t>(m.dataend - m.datastart); };
+    bool shared = _currentImage.empty() || _currentImage.datastart == _originalImage.datastart;
+    _display->setHudMemory(bytes(_originalImage), shared ? 0 : bytes(_currentImage), _history.bytesUsed());
+}
+
+void MainWindow::_restoreState(const History::State &state)
+{
+    TRACE_SCOPE("MainWindow::_restoreState");
+    _startOperation("undo / redo");
+    _currentImage = state.image;
+    _currentOverlays = state.overlays;
+    _ccstats = state.ccstats;
+    _cccentroids = state.cccentroids;
+    _HoughCircles = state.circles;
+    _recipe = _history.command();
+    _displayImage(false);
 }
 
 
 void MainWindow::applyThreshold()
 {
+    TRACE_SCOPE("MainWindow::applyThreshold");
+    if (_deferWhileLoading("threshold", [this]() { validateThreshold(); })) return;
     if(_currentImage.empty()) return;
-    // convert to grayscale, single channel with max over rgb
-    // 1) Max-channel grayscale
-    cv::Mat ch[3];
-    cv::split(_originalImage, ch);        // B, G, R
-    cv::Mat maxGray;
-    cv::max(ch[0], ch[1], maxGray);
-    cv::max(maxGray, ch[2], maxGray);
-
-    // 2) Apply threshold
+    // A pending adaptive threshold or detection would land on top of this one
+    _runner->cancel();
     double thres = _binThreshold->value();
-    cv::threshold(maxGray, _currentImage, thres, 255, cv::THRESH_BINARY);
-    if(!_currentMask.empty()){
-        cv::Mat maskedImage;
-        _currentImage.copyTo(maskedImage, _currentMask);
-        _currentImage = maskedImage;
-    }
+    _threshValueLabel->setText("Threshold : " + QString::number((int)thres));
+    _histogram->setThreshold((int)thres);
     _currentOverlays = 0; // reset overlays
-    // 3) Display
+    _startOperation(_binThreshold->isSliderDown() ? "threshold preview" : "threshold");
+
+    if (_binThreshold->isSliderDown()) {
+        // While dragging, only the preview changes: a lookup table on the cached
+        // masked gray, written straight into the displayed buffer. Components, when
+        // live, come from the component tree.
+        if (!_showTreeComponents((int)thres, false))
+            _display->hideConnectedComponents();
+        _display->hideHoughCircles();
+        _display->setImageLut(_pipeline.evaluate(_maskedGrayStage), thresholdLut(thres));
+        _updateHud();
+        return;
+    }
+
+    // Max-channel grayscale and mask come from the pipeline cache,
+    // only the threshold stage is recomputed
+    _pipeline.stage<ThresholdFilter>(_thresholdStage)->setThreshold(thres);
+    _currentImage = _pipeline.evaluate(_thresholdStage);
+    _recipe = _thresholdRecipe(thres);
+    _binarization = ParamSet::BINARY_THRESHOLD;
+    _showTreeComponents((int)thres, true);
+
+    // Display
     _displayImage(false);
-    _threshValueLabel->setText("Threshold : " + QString::number((int)thres));
 }
 
 
 void MainWindow::validateThreshold()
 {
+    TRACE_SCOPE("MainWindow::validateThreshold");
+    if (_deferWhileLoading("threshold", [this]() { validateThreshold(); })) return;
+    if(_currentImage.empty()) return;
+    _runner->cancel();
+    _startOperation("threshold");
+    double thres = _binThreshold->value();
+    _pipeline.stage<ThresholdFilter>(_thresholdStage)->setThreshold(thres);
+    _currentImage = _pipeline.evaluate(_thresholdStage);
+    _recipe = _thresholdRecipe(thres);
+    _binarization = ParamSet::BINARY_THRESHOLD;
+    _currentOverlays = 0;
+    _showTreeComponents((int)thres, true);
     _displayImage(true);
 }
 
 void MainWindow::resetImage()
 {
-    _currentImage = _originalImage.clone();
-    _currentMask = cv::Mat();
+    TRACE_SCOPE("MainWindow::resetImage");
+    if (_deferWhileLoading("reset", [this]() { resetImage(); })) return;
+    _startOperation("reset");
+    _runner->cancel();
+    _setMask(cv::Mat());
+    _showBase();
     _currentOverlays = 0;
-    _stackIndex = -1;
-    _displayedImageStack.clear();
-    _overlayStack.clear();
+    _history.clear(_originalImage);
     _displayImage();
+    _updateHistogram();
 }
 
 void MainWindow::connectedComponentsMode()
 {
+    TRACE_SCOPE("MainWindow::connectedComponentsMode");
+    if (_deferWhileLoading("connected components", [this]() { connectedComponentsMode(); })) return;
     if(_currentImage.empty()) return;
-    cv::Mat gray;
-    if (_currentImage.channels() == 3)
-        cv::cvtColor(_currentImage, gray, cv::COLOR_BGR2GRAY);
-    else
-        gray = _currentImage.clone();
-
-    // Ensure binary image (threshold if needed)
-    cv::Mat binImg;
-    cv::threshold(gray, binImg, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
-
-    // Connected components
-    cv::Mat labels, stats, centroids;
-    int n = cv::connectedComponentsWithStats(binImg, labels, stats, centroids);
-
-    // Create a color output where each component has a different color, for display purpose
-    cv::Mat coloredLabels = cv::Mat::zeros(labels.size(), CV_8UC3);
-    cv::RNG rng(12345);
-
-    std::vector<cv::Vec3b> colors(n);
-    colors[0] = cv::Vec3b(0,0,0); // background
-    for (int i = 1; i < n; i++)
-        colors[i] = cv::Vec3b(rng.uniform(50,255), rng.uniform(50,255), rng.uniform(50,255));
-
-    for (int y = 0; y < labels.rows; y++)
-        for (int x = 0; x < labels.cols; x++)
-            coloredLabels.at<cv::Vec3b>(y,x) = colors[ labels.at<int>(y,x) ];
+    _runner->cancel();
+    _startOperation("connected components");
+    int algorithm = _ccAlgorithm->currentData().toInt();
+    bool colorize = !_ccLabelMap->isChecked();
+    // Nothing is left outside the mask, only its bounds are labeled
+    cv::Rect region;
+    if (_currentRuns && _currentRuns->size == _currentImage.size())
+        region = _currentRuns->bounds;
+    ComponentsResult cc = labelComponents(_currentImage, algorithm, colorize, region);
+
+    _ccTiming->setText(QString("%1 components - binarize %2 ms, label %3 ms, color %4 ms")
+                       .arg(cc.count - 1)
+                       .arg(cc.binarizeMs, 0, 'f', 1)
+                       .arg(cc.labelingMs, 0, 'f', 1)
+                       .arg(cc.colorizeMs, 0, 'f', 1));
 
     _currentOverlays |= CONNECTED_COMPONENTS;
-    _ccstats = stats;
-    _cccentroids = centroids;
+    _ccstats = cc.stats;
+    _cccentroids = cc.centroids;
+    _updateTracks();
     // Show the updated colored image
-    _displayImage(coloredLabels);
+    History::Command recipe = _recipe.then("connected components", [algorithm, colorize, region](const cv::Mat &input) {
+        return labelComponents(input, algorithm, colorize, region).display;
+    });
+    _displayImage(cc.display, recipe);
 }
 
 void MainWindow::applyMask()
 {
-    if(_currentImage.empty()) return;
+    TRACE_SCOPE("MainWindow::applyMask");
+    if (_deferWhileLoading("mask", [this]() { applyMask(); })) return;
+    _combineMask(MASK_REPLACE);
+}
 
-    _currentMask = _display->getMaskFromTool();
-    if(_currentMask.empty()) return;
+void MainWindow::addToMask()
+{
+    TRACE_SCOPE("MainWindow::addToMask");
+    if (_deferWhileLoading("mask", [this]() { addToMask(); })) return;
+    _combineMask(MASK_ADD);
+}
+
+void MainWindow::subtractFromMask()
+{
+    TRACE_SCOPE("MainWindow::subtractFromMask");
+    if (_deferWhileLoading("mask", [this]() { subtractFromMask(); })) return;
+    _combineMask(MASK_SUBTRACT);
+}
 
-    // Apply mask to current image
+void MainWindow::_combineMask(MaskCombine combine)
+{
+    if(_currentImage.empty()) return;
+    _startOperation("mask");
+
+    cv::Mat tool = _display->getMaskFromTool();
+    if(tool.empty()) return;
+
+    // Arena minus the charging dock, several arenas...: the new shape is combined
+    // with the mask in place, or with the whole frame when there is none
+    cv::Mat mask;
+    bool hasMask = _currentMask.size() == tool.size();
+    if (combine == MASK_ADD && hasMask)
+        cv::bitwise_or(_currentMask, tool, mask);
+    else if (combine == MASK_SUBTRACT) {
+        cv::Mat keep;
+        cv::bitwise_not(tool, keep);
+        if (hasMask)
+            cv::bitwise_and(_currentMask, keep, mask);
+        else
+            mask = keep;
+    } else
+        mask = tool;
+    _setMask(mask);
+
+    // Apply mask to current image, only its spans are copied
+    std::shared_ptr<const MaskRuns> runs = _currentRuns;
     cv::Mat maskedImage;
-    _currentImage.copyTo(maskedImage, _currentMask);
+    copyRuns(_currentImage, *runs, maskedImage);
 
     _currentImage = maskedImage;
+    _recipe = _recipe.then("mask", [runs](const cv::Mat &input) {
+        if (runs->size != input.size())
+            return input;
+        cv::Mat maskedImage;
+        copyRuns(input, *runs, maskedImage);
+        return maskedImage;
+    });
     _displayImage();
+    _updateHistogram();
 }
 
 void MainWindow::getHoughParams()
 {
+    TRACE_SCOPE("MainWindow::getHoughParams");
     _params.dp        = dpEdit->text().toDouble();
     _params.minDist   = minDistEdit->text().toDouble();
     _params.param1    = param1Edit->text().toDouble();
     _params.param2    = param2Edit->text().toDouble();
     _params.minRadius = minRadiusEdit->text().toInt();
     _params.maxRadius = maxRadiusEdit->text().toInt();
+    _params.minCircularity = minCircularityEdit->text().toDouble();
+    _updateComponentCounts();
 }
 
 void MainWindow::applyHoughCircles()
 {
-    if(_currentImage.empty()) return;
+    TRACE_SCOPE("MainWindow::applyHoughCircles");
+    if (_deferWhileLoading("hough circles", [this]() { applyHoughCircles(); })) return;
+    _detectCircles(true);
+}
 
-    // Convert to grayscale
-    cv::Mat gray;
-    if (_currentImage.channels() == 3){
-        // 1) Max-channel grayscale
-        cv::Mat ch[3];
-        cv::split(_currentImage, ch);
-        cv::max(ch[0], ch[1], gray);
-        cv::max(gray, ch[2], gray);
-    } else {
-        gray = _currentImage.clone();
+// From half to twice the current value, geometric steps rounded to halves
+static std::vector<double> sweepValues(double center, int count = 8)
+{
+    std::vector<double> values;
+    center = std::max(center, 1.0);
+    for (int i = 0; i < count; i++) {
+        double v = std::round(center * std::pow(2.0, 2.0 * i / (count - 1) - 1.0) * 2.0) / 2.0;
+        v = std::max(v, 0.5);
+        if (values.empty() || v > values.back())
+            values.push_back(v);
     }
+    return values;
+}
 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-
-    // Apply Hough Circle Transform
-    try {
-    cv::HoughCircles(gray, _HoughCircles, cv::HOUGH_GRADIENT,
-                     _params.dp, _params.minDist,
-                     _params.param1, _params.param2,
-                     _params.minRadius, _params.maxRadius);
-    } catch (const cv::Exception &e) {
-        QMessageBox::critical(this, "Hough Circles Error",
-                              QString("Error: %1").arg(e.what()));
-        QApplication::restoreOverrideCursor();
-        return;
-    }
-    int numCircles = static_cast<int>(_HoughCircles.size());
-    QApplication::restoreOverrideCursor();
+void MainWindow::_sweepHough()
+{
+    TRACE_SCOPE("MainWindow::_sweepHough");
+    if (_deferWhileLoading("hough sweep", [this]() { _sweepHough(); })) return;
+    if(_currentImage.empty()) return;
+    _startOperation("hough sweep");
+
+    getHoughParams();
+    cv::Mat input = _currentImage;
+    cv::Mat mask = _currentMask;
+    HoughParams params = _params;
+    circleDetector detector = static_cast<circleDetector>(_circleDetector->currentData().toInt());
+    std::vector<double> param1Values = sweepValues(params.param1);
+    std::vector<double> param2Values = sweepValues(params.param2);
+
+    _runner->submit([this, input, mask, params, detector, param1Values, param2Values](const AsyncRunner::CancelFlag &cancelled) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: hough sweep");
+        // Grayscale and mask region are shared by all the combinations
+        cv::Mat gray;
+        maxChannelGray(input, gray);
+        cv::Mat counts;
+        try {
+            counts = houghSweep(gray, params, param1Values, param2Values, mask, &cancelled, detector);
+        } catch (const cv::Exception &e) {
+            QString error = e.what();
+            return [this, error]() {
+                QMessageBox::critical(this, "Hough Sweep Error",
+                                      QString("Error: %1").arg(error));
+            };
+        }
 
-    QMessageBox::information(this, "Hough Circles Result",
-                             QString("Found %1 circles").arg(numCircles));
+        // Back on the GUI thread
+        return [this, param1Values, param2Values, counts, params]() {
+            _sweep->setSweep(param1Values, param2Values, counts);
+            _sweep->setCurrent(params.param1, params.param2);
+            _sweep->show();
+            _updateHud();
+        };
+    });
+}
 
-    _currentOverlays |= HOUGH_CIRCLES;
-    // Display the updated image with circles
-    _displayImage();
+void MainWindow::_detectCircles(bool report)
+{
+    TRACE_SCOPE("MainWindow::_detectCircles");
+    if(_currentImage.empty()) return;
+    _startOperation("hough circles");
+
+    cv::Mat input = _currentImage;
+    cv::Mat mask = _currentMask;
+    HoughParams params = _params;
+    circleDetector detector = static_cast<circleDetector>(_circleDetector->currentData().toInt());
+
+    _runner->submit([this, input, mask, params, detector, report](const AsyncRunner::CancelFlag &cancelled) -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: hough circles");
+        // Convert to grayscale
+        cv::Mat gray;
+        maxChannelGray(input, gray);
+        if (cancelled) return AsyncRunner::Completion();
+
+        // Same image, mask and parameters as an earlier run, in this session or a previous one.
+        // The image is the one detected on, so whatever produced it is part of the key.
+        const char *detectorName = detector == ANNULUS_DETECTOR ? "annulusCircles" :
+                                   detector == BLOB_DETECTOR ? "blobCircles" : "houghCirclesTiled";
+        const uint64_t key = CacheKey(detectorName).add(gray).add(mask).add(params, detector).value();
+        ResultCache::Entry cached;
+        const bool hit = _resultCache.load(key, cached);
+
+        // Selected detector, in parallel tiles over the masked region only
+        std::vector<cv::Vec3f> circles = cached.circles;
+        cv::TickMeter tm;
+        try {
+            if (!hit) {
+                tm.start();
+                circles = detectCircles(gray, params, detector, mask, &cancelled);
+                tm.stop();
+                // Results of a cancelled run may be partial
+                if (cancelled) return AsyncRunner::Completion();
+                cached.circles = circles;
+                _resultCache.store(key, cached);
+            }
+        } catch (const cv::Exception &e) {
+            QString error = e.what();
+            return [this, error]() {
+                QMessageBox::critical(this, "Hough Circles Error",
+                                      QString("Error: %1").arg(error));
+            };
+        }
+
+        // Back on the GUI thread
+        double ms = tm.getTimeMilli();
+        return [this, input, circles, report, hit, detector, ms]() {
+            // Image changed while running, the circles are stale
+            if (_currentImage.data != input.data) return;
+            if (hit) _operation += " (cached)";
+            QString name = _circleDetector->itemText(_circleDetector->findData(detector));
+            _detectorResults[detector] = hit ? QString("%1: %2 circles, cached").arg(name).arg(circles.size())
+                                             : QString("%1: %2 circles, %3 ms").arg(name).arg(circles.size())
+                                                                              .arg(ms, 0, 'f', 1);
+            QStringList lines;
+            for (const auto &result : _detectorResults)
+                lines << result.second;
+            _detectorTiming->setText(lines.join("\n"));
+
+            _HoughCircles = circles;
+            int numCircles = static_cast<int>(_HoughCircles.size());
+            _currentOverlays |= HOUGH_CIRCLES;
+            _updateTracks();
+            // Display the updated image with circles
+            _displayImage();
+
+            if (report)
+                QMessageBox::information(this, "Hough Circles Result",
+                                         QString("Found %1 circles").arg(numCircles));
+        };
+    });
 }
 
 void MainWindow::applyAdaptativeThreshold()
 {
+    TRACE_SCOPE("MainWindow::applyAdaptativeThreshold");
+    if (_deferWhileLoading("adaptative threshold", [this]() { applyAdaptativeThreshold(); })) return;
     if(_originalImage.empty()) return;
-    // convert to grayscale, single channel with max over rgb
-    // 1) Max-channel grayscale
-    cv::Mat ch[3];
-    cv::split(_originalImage, ch);        // B, G, R
-    cv::Mat maxGray;
-    cv::max(ch[0], ch[1], maxGray);
-    cv::max(maxGray, ch[2], maxGray);
-
-    // 2) Apply adaptative threshold
-    int blockSize = adaptBlockSizeEdit->text().toInt();
-    if (blockSize % 2 == 0) blockSize += 1; // must be odd
-    double C = adaptCEdit->text().toDouble();
-    int method = (_adaptParams.method == MEAN_C) ? cv::ADAPTIVE_THRESH_MEAN_C : cv::ADAPTIVE_THRESH_GAUSSIAN_C;
-
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    try {
-        cv::adaptiveThreshold(maxGray, _currentImage, 255, method,
-                            cv::THRESH_BINARY, blockSize, C);
-    } catch (const cv::Exception &e) {
-        QMessageBox::critical(this, "Adaptative Threshold Error",
-                              QString("Error: %1").arg(e.what()));
-        QApplication::restoreOverrideCursor();
+    _startOperation("adaptative threshold");
+
+    _adaptParams.blockSize = adaptBlockSizeEdit->text().toInt();
+    _adaptParams.C = adaptCEdit->text().toDouble();
+    _pipeline.stage<AdaptiveThresholdFilter>(_adaptiveStage)->setParams(_adaptParams);
+    _binarization = ParamSet::ADAPTATIVE_THRESHOLD;
+
+    // Same parameters on the same image: only the mask stage may need an update
+    if (_pipeline.isUpToDate(_adaptiveStage)) {
+        _currentImage = _pipeline.evaluate(_maskedAdaptiveStage);
+        _recipe = _adaptiveRecipe(_adaptParams);
+        _displayImage();
         return;
     }
-    QApplication::restoreOverrideCursor();
-    if(!_currentMask.empty()){
-        cv::Mat maskedImage;
-        _currentImage.copyTo(maskedImage, _currentMask);
-        _currentImage = maskedImage;
-    }
 
-    _displayImage();
-}
\ No newline at end of file
+    // Max-channel grayscale is evaluated (or reused) here, the threshold itself runs in the background
+    Pipeline::Task task = _pipeline.prepare(_adaptiveStage);
+
+    _runner->submit([this, task](const AsyncRunner::CancelFlag &) mutable -> AsyncRunner::Completion {
+        TRACE_SCOPE("job: adaptative threshold");
+        try {
+            task.run();
+        } catch (const cv::Exception &e) {
+            QString error = e.what();
+            return [this, error]() {
+                QMessageBox::critical(this, "Adaptative Threshold Error",
+                                      QString("Error: %1").arg(error));
+            };
+        }
+
+        // Back on the GUI thread
+        return [this, task]() {
+            // Image or mask changed while running, the result is stale
+            if (!_pipeline.commit(task)) return;
+            _currentImage = _pipeline.evaluate(_maskedAdaptiveStage);
+            _recipe = _adaptiveRecipe(_pipeline.stage<AdaptiveThresholdFilter>(_adaptiveStage)->params());
+            _displayImage();
+        };
+    });
+}
@@ -12,32 +12,29 @@
 #include <opencv2/opencv.hpp>
 #include <QDoubleSpinBox>
 #include <QShortcut>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QElapsedTimer>
+#include <map>
 #include "ImageDisplay.h"
+#include "AsyncRunner.h"
+#include "Params.h"
+#include "Pipeline.h"
+#include "HistogramWidget.h"
+#include "History.h"
+#include "VideoSource.h"
+#include "ParamSet.h"
+#include "SweepWidget.h"
+#include "Background.h"
+#include "Tracker.h"
+#include "MaskRuns.h"
+#include "ResultCache.h"
+#include "ComponentTree.h"
 
 #define CONNECTED_COMPONENTS 0x01
 #define HOUGH_CIRCLES        0x02
 
-enum adaptativeMethod {
-    MEAN_C,
-    GAUSSIAN_C
-};
-
-struct HoughParams {
-    double dp;
-    double minDist;
-    double param1;
-    double param2;
-    int minRadius;
-    int maxRadius;
-};
-
-
-struct AdaptativeParams {
-    adaptativeMethod method;
-    int blockSize;
-    double C;
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -46,8 +43,19 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Loads in the background, a reduced preview is shown first
+    void openImage(const QString &path);
+
 private:
     ImageDisplay *_display;
+    AsyncRunner *_runner;
+    AsyncRunner *_loader;
+    AsyncRunner *_previewLoader;
+    AsyncRunner *_bgLearner;
+    AsyncRunner *_treeBuilder;
+    bool _loading = false;
+    // Operations asked for while an image loads, run once it is there
+    std::vector<std::pair<QString, std::function<void()>>> _pendingOps;
     QWidget *_sidePanel;
     QVBoxLayout *_sideLayout;
     QLabel *_threshValueLabel;
@@ -55,11 +63,55 @@ private:
     cv::Mat _originalImage;
     cv::Mat _currentImage;
     cv::Mat _currentMask;
+    std::shared_ptr<const MaskRuns> _currentRuns;    // _currentMask as runs, null without mask
+
+    enum MaskCombine { MASK_REPLACE, MASK_ADD, MASK_SUBTRACT };
 
     void _setupUI();
+    void _setupPipeline();
+    void _setMask(const cv::Mat &mask);
+    void _combineMask(MaskCombine combine);
+    void _updateHistogram();
+    void _buildComponentTree();
+    void _updateComponentCounts();
+    bool _showTreeComponents(int threshold, bool keep);
+    History::Command _thresholdRecipe(double thres) const;
+    History::Command _adaptiveRecipe(const AdaptativeParams &params) const;
+    cv::Mat _activeBackground() const;
+    void _showBase();
+    void _updateBackground();
+    void _learnBackgroundFromVideo();
     void _loadImage();
+    void _loadVideo();
+    void _imageLoaded(const cv::Mat &image);
+    bool _deferWhileLoading(const QString &name, const std::function<void()> &op);
+    void _saveParams();
+    void _loadParams();
+    void _setFrame(int index, const cv::Mat &frame);
+    void _detectCircles(bool report);
+    void _updateTracks();
+    void _sweepHough();
     void _displayImage(bool addToStack = true);
-    void _displayImage(cv::Mat img, bool addToStack = true);
+    void _displayImage(cv::Mat img, const History::Command &recipe, bool addToStack = true);
+    void _restoreState(const History::State &state);
+    void _startOperation(const QString &name);
+    void _updateHud();
+
+    // Foreground -> max channel -> mask -> threshold, and max channel -> adaptative threshold -> mask
+    Pipeline _pipeline;
+    Pipeline::StageId _foregroundStage;
+    Pipeline::StageId _grayStage;
+    Pipeline::StageId _maskedGrayStage;
+    Pipeline::StageId _thresholdStage;
+    Pipeline::StageId _adaptiveStage;
+    Pipeline::StageId _maskedAdaptiveStage;
+    Pipeline::StageId _histogramStage;
+
+    HistogramWidget *_histogram;
+    QPushButton *_otsuBtn;
+    QPushButton *_triangleBtn;
+    int _otsuSuggestion = -1;
+    int _triangleSuggestion = -1;
 
     uint8_t _currentOverlays = 0;
     cv::Mat _ccstats;
@@ -67,10 +119,30 @@ private:
     std::vector<cv::Vec3f> _HoughCircles;
 
     QSlider* _binThreshold;
+    VideoSource *_video;
+    QSlider *_timeline;
+    QLabel *_frameLabel;
+    QString _videoPath;
+
+    BackgroundModel _background;
+    QComboBox *_bgMode;
+    QCheckBox *_bgLearn;
+    QCheckBox *_bgSubtract;
+    QLabel *_bgStatus;
+    QComboBox *_ccAlgorithm;
+    QCheckBox *_ccLabelMap;
+    QLabel *_ccTiming;
+    QCheckBox *_ccLive;
+    // Components of every threshold of the masked gray image, built in the background
+    // when live components are on. Only valid while that image is _treeSource.
+    ComponentTree _componentTree;
+    cv::Mat _treeSource;
     double _imgScale = 1.0;
 
     HoughParams _params = {1.0, 20.0, 10.0, 14.0, 40, 60};
+    ResultCache _resultCache;      // detections from earlier runs, on disk
     AdaptativeParams _adaptParams = {MEAN_C, 11, -10.0};
+    ParamSet::Binarization _binarization = ParamSet::BINARY_THRESHOLD;  // last one applied, saved with the parameters
 
     QLineEdit *dpEdit;
     QLineEdit *minDistEdit;
@@ -78,15 +150,28 @@ private:
     QLineEdit *param2Edit;
     QLineEdit *minRadiusEdit;
     QLineEdit *maxRadiusEdit;
+    QLineEdit *minCircularityEdit;
+    QComboBox *_circleDetector;
+    QLabel *_detectorTiming;
+    std::map<int, QString> _detectorResults;   // per detector, its last count and time
+    SweepWidget *_sweep;
+    QCheckBox *_trackCheck;
+    Tracker _tracker;
+    int _frameIndex = 0;         // video frame, or count of images opened
+    QSpinBox *_sweepExpected;
 
     QRadioButton *meanCBtn;
     QRadioButton *gaussianCBtn;
     QLineEdit *adaptCEdit;
     QLineEdit *adaptBlockSizeEdit;
 
-    std::vector<cv::Mat> _displayedImageStack;
-    std::vector<uint8_t> _overlayStack;
-    int _stackIndex = -1; // Allows undo functionality
+    // Allows undo functionality
+    History _history;
+    History::Command _recipe;   // how _currentImage is obtained from _originalImage
+
+    // Operation in progress, timed until its result is displayed
+    QString _operation;
+    QElapsedTimer _operationClock;
 
 private slots:
     void resetImage();
@@ -94,6 +179,8 @@ private slots:
     void validateThreshold();
     void connectedComponentsMode();
     void applyMask();
+    void addToMask();
+    void subtractFromMask();
     void getHoughParams();
     void applyHoughCircles();
     void applyAdaptativeThreshold();
@@ -0,0 +1,28 @@
+#include "MaskRuns.h"
+#include <opencv2/imgproc.hpp>
+
+MaskRuns MaskRuns::fromMask(const cv::Mat &mask)
+{
+    CV_Assert(mask.type() == CV_8UC1);
+    MaskRuns runs;
+    runs.size = mask.size();
+    runs.bounds = cv::boundingRect(mask);
+    runs.rowStart.reserve(runs.bounds.height + 1);
+    runs.rowStart.push_back(0);
+
+    for (int y = runs.bounds.y; y < runs.bounds.y + runs.bounds.height; y++) {
+        const uchar *m = mask.ptr<uchar>(y);
+        int x = runs.bounds.x;
+        const int end = runs.bounds.x + runs.bounds.width;
+        while (x < end) {
+            while (x < end && !m[x]) x++;
+            if (x == end) break;
+            int x0 = x;
+            while (x < end && m[x]) x++;
+            runs.spans.push_back({x0, x});
+            runs.area += x - x0;
+        }
+        runs.rowStart.push_back(static_cast<int>(runs.spans.size()));
+    }
+    return runs;
+}
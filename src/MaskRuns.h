@@ -0,0 +1,30 @@
+#ifndef MASKRUNS_H
+#define MASKRUNS_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// A mask as horizontal runs inside its bounding rectangle. Operations given runs only
+// visit the covered pixels instead of the full frame, and never read the mask image.
+struct MaskRuns {
+    struct Span {
+        int x0;     // first covered column
+        int x1;     // one past the last one
+    };
+
+    cv::Size size;                  // frame the mask applies to
+    cv::Rect bounds;                // bounding rectangle of the covered pixels
+    std::vector<int> rowStart;      // per row of bounds, first span; bounds.height + 1 entries
+    std::vector<Span> spans;
+    size_t area = 0;                // covered pixels
+
+    bool empty() const { return area == 0; }
+    // Spans of image row y, which must lie inside bounds
+    const Span *rowBegin(int y) const { return spans.data() + rowStart[y - bounds.y]; }
+    const Span *rowEnd(int y) const { return spans.data() + rowStart[y - bounds.y + 1]; }
+
+    // Non zero pixels of a CV_8UC1 mask
+    static MaskRuns fromMask(const cv::Mat &mask);
+};
+
+#endif // MASKRUNS_H
@@ -0,0 +1,279 @@
+#include "OverlayLayer.h"
+#include <QFontMetrics>
+#include <QPolygonF>
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_set>
+
+// Above this many visible markers, they are drawn as a single batch of points
+static const size_t DenseMarkers = 4000;
+
+void GridIndex::clear()
+{
+    _count = 0;
+    _cols = _rows = 0;
+    _start.clear();
+    _items.clear();
+    _seen.clear();
+}
+
+bool GridIndex::_cellRange(const QRectF &rect, int &x0, int &y0, int &x1, int &y1) const
+{
+    if (rect.right() < _extent.left() || rect.left() > _extent.right()
+        || rect.bottom() < _extent.top() || rect.top() > _extent.bottom())
+        return false;
+    x0 = std::clamp(static_cast<int>(std::floor((rect.left() - _extent.left()) / _cellW)), 0, _cols - 1);
+    x1 = std::clamp(static_cast<int>(std::floor((rect.right() - _extent.left()) / _cellW)), 0, _cols - 1);
+    y0 = std::clamp(static_cast<int>(std::floor((rect.top() - _extent.top()) / _cellH)), 0, _rows - 1);
+    y1 = std::clamp(static_cast<int>(std::floor((rect.bottom() - _extent.top()) / _cellH)), 0, _rows - 1);
+    return true;
+}
+
+void GridIndex::build(const std::vector<QRectF> &bounds)
+{
+    clear();
+    if (bounds.empty()) return;
+
+    double left = bounds[0].left(), right = bounds[0].right();
+    double top = bounds[0].top(), bottom = bounds[0].bottom();
+    for (const QRectF &b : bounds) {
+        left = std::min(left, b.left());
+        right = std::max(right, b.right());
+        top = std::min(top, b.top());
+        bottom = std::max(bottom, b.bottom());
+    }
+    _extent = QRectF(left, top, std::max(1.0, right - left), std::max(1.0, bottom - top));
+
+    // About four items per cell
+    double cell = std::sqrt(_extent.width() * _extent.height() * 4.0 / bounds.size());
+    _cols = std::clamp(static_cast<int>(std::ceil(_extent.width() / cell)), 1, 1024);
+    _rows = std::clamp(static_cast<int>(std::ceil(_extent.height() / cell)), 1, 1024);
+    _cellW = _extent.width() / _cols;
+    _cellH = _extent.height() / _rows;
+
+    // Counting pass, then fill: items of a cell are contiguous
+    _start.assign(_cols * _rows + 1, 0);
+    int x0, y0, x1, y1;
+    for (const QRectF &b : bounds) {
+        _cellRange(b, x0, y0, x1, y1);
+        for (int cy = y0; cy <= y1; cy++)
+            for (int cx = x0; cx <= x1; cx++)
+                _start[cy * _cols + cx + 1]++;
+    }
+    std::partial_sum(_start.begin(), _start.end(), _start.begin());
+    _items.resize(_start.back());
+    std::vector<int> fill(_start.begin(), _start.end() - 1);
+    for (int i = 0; i < static_cast<int>(bounds.size()); i++) {
+        _cellRange(bounds[i], x0, y0, x1, y1);
+        for (int cy = y0; cy <= y1; cy++)
+            for (int cx = x0; cx <= x1; cx++)
+                _items[fill[cy * _cols + cx]++] = i;
+    }
+
+    _count = bounds.size();
+    _seen.assign(_count, 0u);
+    _stamp = 0;
+}
+
+void ComponentOverlay::clear()
+{
+    _stats = cv::Mat();
+    _centers.clear();
+    _areas.clear();
+    _byArea.clear();
+    _labels.clear();
+    _shownLabels.clear();
+    _index.clear();
+}
+
+size_t ComponentOverlay::bytes() const
+{
+    size_t total = _stats.empty() ? 0 : static_cast<size_t>(_stats.dataend - _stats.datastart);
+    total += _centers.capacity() * sizeof(QPointF);
+    total += (_areas.capacity() + _byArea.capacity()) * sizeof(int);
+    total += _labels.capacity() * sizeof(QStaticText);
+    for (const auto &level : _shownLabels)
+        total += level.second.capacity();
+    return total + _index.bytes();
+}
+
+void ComponentOverlay::set(const cv::Mat &stats, const cv::Mat &centroids)
+{
+    clear();
+    _stats = stats;
+
+    int n = stats.rows;  // number of components
+    std::vector<QRectF> bounds;
+    for (int i = 1; i < n; i++)  // skip background (i=0)
+    {
+        double cx = centroids.at<double>(i, 0);
+        double cy = centroids.at<double>(i, 1);
+        _centers.emplace_back(cx, cy);
+        _areas.push_back(stats.at<int>(i, cv::CC_STAT_AREA));
+        bounds.emplace_back(cx, cy, 0, 0);
+    }
+    _index.build(bounds);
+    _labels.resize(_centers.size());
+
+    _byArea.resize(_centers.size());
+    std::iota(_byArea.begin(), _byArea.end(), 0);
+    std::stable_sort(_byArea.begin(), _byArea.end(), [this](int a, int b) { return _areas[a] > _areas[b]; });
+}
+
+const std::vector<char> &ComponentOverlay::_declutter(const QFontMetrics &fm, double scale)
+{
+    // Zoom levels a quarter octave apart share their label selection
+    int key = static_cast<int>(std::lround(std::log2(scale) * 4));
+    auto it = _shownLabels.find(key);
+    if (it != _shownLabels.end())
+        return it->second;
+
+    // One label per label-sized cell, in image pixels at this zoom
+    double cellW = (fm.horizontalAdvance("0000 (0000, 0000)") + 6) / scale;
+    double cellH = (fm.height() + 6) / scale;
+    std::vector<char> shown(_centers.size(), 0);
+    std::unordered_set<long long> taken;
+    for (int i : _byArea) {
+        long long cx = static_cast<long long>(std::floor(_centers[i].x() / cellW));
+        long long cy = static_cast<long long>(std::floor(_centers[i].y() / cellH));
+        if (taken.insert((cy << 32) ^ (cx & 0xffffffffLL)).second)
+            shown[i] = 1;
+    }
+    return _shownLabels.emplace(key, std::move(shown)).first->second;
+}
+
+void ComponentOverlay::draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale)
+{
+    if (_index.empty()) return;
+
+    QFontMetrics fm = painter.fontMetrics();
+    // Labels extend right and above their centroid
+    double margin = fm.horizontalAdvance("0000 (0000, 0000)") / scale;
+    std::vector<int> inView;
+    _index.query(visible.adjusted(-margin, -margin, margin, margin), [&](int i) { inView.push_back(i); });
+    if (inView.empty()) return;
+
+    auto toWidget = [&](const QPointF &p) {
+        return QPointF(p.x() * scale + offset.x(), p.y() * scale + offset.y());
+    };
+
+    painter.setPen(QPen(Qt::yellow, 2));
+
+    // Draw centroids
+    if (inView.size() > DenseMarkers) {
+        QPolygonF points;
+        points.reserve(static_cast<int>(inView.size()));
+        for (int i : inView)
+            points << toWidget(_centers[i]);
+        painter.drawPoints(points);
+    } else {
+        for (int i : inView)
+            painter.drawEllipse(toWidget(_centers[i]), 4, 4);
+    }
+
+    // Draw area text, only where it does not pile up at this zoom
+    const std::vector<char> &shown = _declutter(fm, scale);
+    QPointF textOffset(6, -6 - fm.ascent());
+    for (int i : inView) {
+        if (!shown[i]) continue;
+        QStaticText &label = _labels[i];
+        if (label.text().isEmpty()) {
+            label.setText(QString::number(_areas[i]) + " (" + QString::number(_centers[i].x(), 'f', 0) + ", " + QString::number(_centers[i].y(), 'f', 0) + ")");
+            label.setTextFormat(Qt::PlainText);
+            label.setPerformanceHint(QStaticText::AggressiveCaching);
+        }
+        painter.drawStaticText(toWidget(_centers[i]) + textOffset, label);
+    }
+}
+
+void CircleOverlay::clear()
+{
+    _circles.clear();
+    _index.clear();
+}
+
+void CircleOverlay::set(const std::vector<cv::Vec3f> &circles)
+{
+    _circles = circles;
+    std::vector<QRectF> bounds;
+    bounds.reserve(circles.size());
+    for (const auto &c : circles)
+        bounds.emplace_back(c[0] - c[2], c[1] - c[2], 2 * c[2], 2 * c[2]);
+    _index.build(bounds);
+}
+
+void CircleOverlay::draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale)
+{
+    if (_index.empty()) return;
+
+    painter.setPen(QPen(Qt::green, 2));
+    QPolygonF dots;
+    _index.query(visible, [&](int i) {
+        const cv::Vec3f &circle = _circles[i];
+        QPointF center(circle[0] * scale + offset.x(), circle[1] * scale + offset.y());
+        double radius = circle[2] * scale;
+        // Circles smaller than a couple of pixels on screen are only a dot
+        if (radius < 2)
+            dots << center;
+        else
+            painter.drawEllipse(center, radius, radius);
+    });
+    if (!dots.isEmpty())
+        painter.drawPoints(dots);
+}
+
+void TrackOverlay::clear()
+{
+    _trails.clear();
+    _ids.clear();
+    _index.clear();
+}
+
+size_t TrackOverlay::bytes() const
+{
+    size_t total = _ids.capacity() * sizeof(int) + _trails.capacity() * sizeof(QPolygonF);
+    for (const QPolygonF &trail : _trails)
+        total += trail.capacity() * sizeof(QPointF);
+    return total + _index.bytes();
+}
+
+void TrackOverlay::set(const std::vector<Tracker::Track> &tracks)
+{
+    _trails.clear();
+    _ids.clear();
+    std::vector<QRectF> bounds;
+    _trails.reserve(tracks.size());
+    _ids.reserve(tracks.size());
+    bounds.reserve(tracks.size());
+    for (const Tracker::Track &track : tracks) {
+        QPolygonF trail;
+        trail.reserve(static_cast<qsizetype>(track.trail.size()));
+        for (const cv::Point2f &p : track.trail)
+            trail << QPointF(p.x, p.y);
+        bounds.push_back(trail.boundingRect().adjusted(-1, -1, 1, 1));
+        _trails.push_back(std::move(trail));
+        _ids.push_back(track.id);
+    }
+    _index.build(bounds);
+}
+
+void TrackOverlay::draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale)
+{
+    if (_index.empty()) return;
+
+    const bool labels = scale > 0.3;    // ids would only clutter a zoomed out view
+    QTransform toScreen(scale, 0, 0, scale, offset.x(), offset.y());
+    _index.query(visible, [&](int i) {
+        // Golden ratio hues keep neighbouring ids apart
+        QColor color = QColor::fromHsvF(std::fmod(_ids[i] * 0.618034, 1.0), 0.9, 1.0);
+        painter.setPen(QPen(color, 2));
+        QPolygonF trail = toScreen.map(_trails[i]);
+        if (trail.size() > 1)
+            painter.drawPolyline(trail);
+        painter.drawEllipse(trail.last(), 3, 3);
+        if (labels)
+            painter.drawText(trail.last() + QPointF(5, -5), QString::number(_ids[i]));
+    });
+}
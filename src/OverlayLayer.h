@@ -0,0 +1,115 @@
+#ifndef OVERLAYLAYER_H
+#define OVERLAYLAYER_H
+
+#include <QPainter>
+#include <QPolygonF>
+#include <QRectF>
+#include <QStaticText>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include "Tracker.h"
+#include <unordered_map>
+#include <vector>
+
+// Uniform grid over image coordinates, returns the items whose bounds fall in a rect
+class GridIndex
+{
+public:
+    void build(const std::vector<QRectF> &bounds);
+    void clear();
+    bool empty() const { return _count == 0; }
+    size_t bytes() const
+    {
+        return (_start.capacity() + _items.capacity()) * sizeof(int) + _seen.capacity() * sizeof(unsigned);
+    }
+
+    // Calls fn(i) once for every item i in a cell touched by rect
+    template <typename Fn>
+    void query(const QRectF &rect, Fn &&fn) const
+    {
+        if (_count == 0) return;
+        int x0, y0, x1, y1;
+        if (!_cellRange(rect, x0, y0, x1, y1)) return;
+        if (++_stamp == 0) {
+            std::fill(_seen.begin(), _seen.end(), 0u);
+            _stamp = 1;
+        }
+        for (int cy = y0; cy <= y1; cy++)
+            for (int cx = x0; cx <= x1; cx++) {
+                int c = cy * _cols + cx;
+                for (int k = _start[c]; k < _start[c + 1]; k++) {
+                    int i = _items[k];
+                    if (_seen[i] == _stamp) continue;
+                    _seen[i] = _stamp;
+                    fn(i);
+                }
+            }
+    }
+
+private:
+    QRectF _extent;
+    double _cellW = 1, _cellH = 1;
+    int _cols = 0, _rows = 0;
+    size_t _count = 0;
+    std::vector<int> _start;    // per cell offset into _items, cols * rows + 1 entries
+    std::vector<int> _items;
+    mutable std::vector<unsigned> _seen;
+    mutable unsigned _stamp = 0;
+
+    bool _cellRange(const QRectF &rect, int &x0, int &y0, int &x1, int &y1) const;
+};
+
+// Connected components centroids with their area and position labels
+class ComponentOverlay
+{
+public:
+    void set(const cv::Mat &stats, const cv::Mat &centroids);
+    void clear();
+    bool isSameAs(const cv::Mat &stats) const { return !stats.empty() && stats.data == _stats.data; }
+    // Approximate memory held, glyph layouts of the labels excluded
+    size_t bytes() const;
+    // visible: part of the image in view, in image pixels
+    void draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale);
+
+private:
+    cv::Mat _stats;
+    std::vector<QPointF> _centers;
+    std::vector<int> _areas;
+    std::vector<int> _byArea;           // largest components first, they keep their label
+    GridIndex _index;
+    std::vector<QStaticText> _labels;   // laid out once, on first draw
+    std::unordered_map<int, std::vector<char>> _shownLabels;  // per zoom level
+
+    const std::vector<char> &_declutter(const QFontMetrics &fm, double scale);
+};
+
+class CircleOverlay
+{
+public:
+    void set(const std::vector<cv::Vec3f> &circles);
+    void clear();
+    bool isSameAs(const std::vector<cv::Vec3f> &circles) const { return circles == _circles; }
+    size_t bytes() const { return _circles.capacity() * sizeof(cv::Vec3f) + _index.bytes(); }
+    void draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale);
+
+private:
+    std::vector<cv::Vec3f> _circles;
+    GridIndex _index;
+};
+
+// Tracker trails, one color per track id, with the id next to the current position
+class TrackOverlay
+{
+public:
+    void set(const std::vector<Tracker::Track> &tracks);
+    void clear();
+    size_t bytes() const;
+    void draw(QPainter &painter, const QRectF &visible, const QPointF &offset, double scale);
+
+private:
+    std::vector<QPolygonF> _trails;
+    std::vector<int> _ids;
+    GridIndex _index;
+};
+
+#endif // OVERLAYLAYER_H
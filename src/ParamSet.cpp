@@ -0,0 +1,120 @@
+#include "ParamSet.h"
+#include "Filters.h"
+#include "Kernels.h"
+#include "ResultCache.h"
+#include <opencv2/imgcodecs.hpp>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+bool ParamSet::save(const std::string &path) const
+{
+    cv::FileStorage file(path, cv::FileStorage::WRITE);
+    if (!file.isOpened())
+        return false;
+
+    std::string maskName;
+    if (!mask.empty()) {
+        maskName = fs::path(path).stem().string() + ".mask.png";
+        if (!cv::imwrite((fs::path(path).parent_path() / maskName).string(), mask))
+            return false;
+    }
+
+    file << "binarization" << (binarization == ADAPTATIVE_THRESHOLD ? "adaptative" : "threshold");
+    file << "threshold" << threshold;
+    file << "adaptative" << "{"
+         << "method" << (adaptative.method == MEAN_C ? "mean" : "gaussian")
+         << "blockSize" << adaptative.blockSize
+         << "C" << adaptative.C
+         << "}";
+    file << "hough" << "{"
+         << "dp" << hough.dp
+         << "minDist" << hough.minDist
+         << "param1" << hough.param1
+         << "param2" << hough.param2
+         << "minRadius" << hough.minRadius
+         << "maxRadius" << hough.maxRadius
+         << "minCircularity" << hough.minCircularity
+         << "detector" << (detector == ANNULUS_DETECTOR ? "annulus" :
+                           detector == BLOB_DETECTOR ? "blob" : "hough gradient")
+         << "}";
+    file << "mask" << maskName;
+    return true;
+}
+
+bool ParamSet::load(const std::string &path)
+{
+    cv::FileStorage file;
+    try {
+        if (!file.open(path, cv::FileStorage::READ))
+            return false;
+    } catch (const cv::Exception &) {
+        return false;
+    }
+
+    binarization = (std::string)file["binarization"] == "adaptative" ? ADAPTATIVE_THRESHOLD : BINARY_THRESHOLD;
+    file["threshold"] >> threshold;
+
+    cv::FileNode a = file["adaptative"];
+    adaptative.method = (std::string)a["method"] == "gaussian" ? GAUSSIAN_C : MEAN_C;
+    a["blockSize"] >> adaptative.blockSize;
+    a["C"] >> adaptative.C;
+
+    cv::FileNode h = file["hough"];
+    h["dp"] >> hough.dp;
+    h["minDist"] >> hough.minDist;
+    h["param1"] >> hough.param1;
+    h["param2"] >> hough.param2;
+    h["minRadius"] >> hough.minRadius;
+    h["maxRadius"] >> hough.maxRadius;
+    if (!h["minCircularity"].empty())
+        h["minCircularity"] >> hough.minCircularity;
+    // Files saved before there was a choice of detector use Hough
+    std::string detectorName = (std::string)h["detector"];
+    detector = detectorName == "annulus" ? ANNULUS_DETECTOR :
+               detectorName == "blob" ? BLOB_DETECTOR : HOUGH_GRADIENT_DETECTOR;
+
+    mask = cv::Mat();
+    std::string maskName = (std::string)file["mask"];
+    if (!maskName.empty()) {
+        mask = cv::imread((fs::path(path).parent_path() / maskName).string(), cv::IMREAD_GRAYSCALE);
+        if (mask.empty())
+            return false;
+    }
+    return true;
+}
+
+cv::Mat ParamSet::binarize(const cv::Mat &frame) const
+{
+    const cv::Mat frameMask = mask.size() == frame.size() ? mask : cv::Mat();
+    cv::Mat binary;
+    if (binarization == BINARY_THRESHOLD) {
+        maxChannelThresholdMasked(frame, threshold, frameMask, binary);
+        return binary;
+    }
+
+    MaxChannelFilter gray;
+    AdaptiveThresholdFilter adaptive;
+    adaptive.setParams(adaptative);
+    binary = adaptive.apply(gray.apply(frame));
+    if (!frameMask.empty()) {
+        cv::Mat masked;
+        binary.copyTo(masked, frameMask);
+        binary = masked;
+    }
+    return binary;
+}
+
+uint64_t ParamSet::cacheKey(const cv::Mat &frame) const
+{
+    CacheKey key("batch detections");
+    key.add(frame).add(int64_t(binarization));
+    if (binarization == BINARY_THRESHOLD)
+        key.add(threshold);
+    else
+        key.add(int64_t(adaptative.method)).add(int64_t(adaptative.blockSize)).add(adaptative.C);
+    key.add(hough, detector);
+    // Only a mask of the frame size is used
+    key.add(mask.size() == frame.size() ? mask : cv::Mat());
+    return key.value();
+}
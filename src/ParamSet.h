@@ -0,0 +1,33 @@
+#ifndef PARAMSET_H
+#define PARAMSET_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include "Params.h"
+
+// Everything needed to run the tuned pipeline on other frames, saved as an OpenCV
+// YAML/JSON file. The mask is stored next to it as a PNG.
+struct ParamSet {
+    enum Binarization {
+        BINARY_THRESHOLD,
+        ADAPTATIVE_THRESHOLD
+    };
+
+    Binarization binarization = BINARY_THRESHOLD;
+    double threshold = 255;
+    AdaptativeParams adaptative = {MEAN_C, 11, -10.0};
+    HoughParams hough = {1.0, 20.0, 10.0, 14.0, 40, 60};
+    circleDetector detector = HOUGH_GRADIENT_DETECTOR;
+    cv::Mat mask;
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    // Binary image of a frame: max channel, threshold, mask
+    cv::Mat binarize(const cv::Mat &frame) const;
+    // Identifies the detections of a frame under these parameters, see ResultCache
+    uint64_t cacheKey(const cv::Mat &frame) const;
+};
+
+#endif // PARAMSET_H
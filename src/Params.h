@@ -0,0 +1,32 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+enum adaptativeMethod {
+    MEAN_C,
+    GAUSSIAN_C
+};
+
+enum circleDetector {
+    HOUGH_GRADIENT_DETECTOR,    // cv::HoughCircles, any radius range
+    ANNULUS_DETECTOR,           // annulus correlation, narrow radius band
+    BLOB_DETECTOR               // contours of the binary image, clean thresholded frames
+};
+
+struct HoughParams {
+    double dp;
+    double minDist;
+    double param1;
+    double param2;
+    int minRadius;
+    int maxRadius;
+    double minCircularity = 0.7;    // blob detector only, 4 pi area / perimeter^2
+};
+
+
+struct AdaptativeParams {
+    adaptativeMethod method;
+    int blockSize;
+    double C;
+};
+
+#endif // PARAMS_H
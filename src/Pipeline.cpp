@@ -0,0 +1,92 @@
+#include "Pipeline.h"
+
+Pipeline::StageId Pipeline::addStage(std::unique_ptr<Filter> filter, StageId input)
+{
+    Stage stage;
+    stage.filter = std::move(filter);
+    stage.input = input;
+    _stages.push_back(std::move(stage));
+    return static_cast<StageId>(_stages.size()) - 1;
+}
+
+void Pipeline::setSource(const cv::Mat &image)
+{
+    _source = image;
+    _sourceGeneration = ++_nextGeneration;
+    // Drop stale outputs right away rather than holding them until the next evaluation
+    for (Stage &stage : _stages) {
+        stage.cache = cv::Mat();
+        stage.generation = 0;
+    }
+}
+
+uint64_t Pipeline::_inputGeneration(StageId id) const
+{
+    StageId input = _stages[id].input;
+    return input == Source ? _sourceGeneration : _stages[input].generation;
+}
+
+bool Pipeline::isUpToDate(StageId id) const
+{
+    if (id == Source)
+        return true;
+    const Stage &stage = _stages[id];
+    return stage.generation != 0
+        && isUpToDate(stage.input)
+        && stage.inputGeneration == _inputGeneration(id)
+        && stage.paramsKey == stage.filter->paramsKey();
+}
+
+cv::Mat Pipeline::_inputOf(StageId id)
+{
+    StageId input = _stages[id].input;
+    return input == Source ? _source : evaluate(input);
+}
+
+cv::Mat Pipeline::evaluate(StageId id)
+{
+    if (id == Source)
+        return _source;
+
+    cv::Mat input = _inputOf(id);
+    Stage &stage = _stages[id];
+    uint64_t inputGeneration = _inputGeneration(id);
+    size_t paramsKey = stage.filter->paramsKey();
+
+    if (stage.generation != 0
+        && stage.inputGeneration == inputGeneration
+        && stage.paramsKey == paramsKey)
+        return stage.cache;
+
+    stage.cache = input.empty() ? cv::Mat() : stage.filter->apply(input);
+    stage.inputGeneration = inputGeneration;
+    stage.paramsKey = paramsKey;
+    stage.generation = ++_nextGeneration;
+    return stage.cache;
+}
+
+Pipeline::Task Pipeline::prepare(StageId id)
+{
+    Task task;
+    task.stage = id;
+    task.input = _inputOf(id);
+    task.inputGeneration = _inputGeneration(id);
+    task.paramsKey = _stages[id].filter->paramsKey();
+    task.filter = _stages[id].filter->clone();
+    return task;
+}
+
+bool Pipeline::commit(const Task &task)
+{
+    Stage &stage = _stages[task.stage];
+    if (!isUpToDate(stage.input)
+        || task.inputGeneration != _inputGeneration(task.stage)
+        || task.paramsKey != stage.filter->paramsKey())
+        return false;
+
+    stage.cache = task.output;
+    stage.inputGeneration = task.inputGeneration;
+    stage.paramsKey = task.paramsKey;
+    stage.generation = ++_nextGeneration;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "Filter.h"
+#include <cstdint>
+#include <vector>
+
+// Graph of Filter stages fed by a source image.
+// Each stage caches its output along with the generation of its input and its
+// parameter key, so only the stages downstream of a change are recomputed.
+class Pipeline
+{
+public:
+    using StageId = int;
+    static constexpr StageId Source = -1;
+
+    // A single stage captured for evaluation off the GUI thread
+    struct Task {
+        StageId stage = Source;
+        cv::Mat input;
+        uint64_t inputGeneration = 0;
+        size_t paramsKey = 0;
+        std::shared_ptr<Filter> filter;
+        cv::Mat output;
+
+        void run() { output = filter->apply(input); }
+    };
+
+    StageId addStage(std::unique_ptr<Filter> filter, StageId input = Source);
+    template <typename T>
+    T *stage(StageId id) const { return static_cast<T*>(_stages[id].filter.get()); }
+
+    void setSource(const cv::Mat &image);
+    const cv::Mat &source() const { return _source; }
+
+    // Returns the output of a stage, recomputing only what is out of date
+    cv::Mat evaluate(StageId id);
+    bool isUpToDate(StageId id) const;
+
+    // Brings the inputs of a stage up to date and captures it as a task
+    Task prepare(StageId id);
+    // Stores the result of a task, unless its inputs or parameters changed meanwhile
+    bool commit(const Task &task);
+
+private:
+    struct Stage {
+        std::unique_ptr<Filter> filter;
+        StageId input = Source;
+        cv::Mat cache;
+        uint64_t inputGeneration = 0;
+        size_t paramsKey = 0;
+        uint64_t generation = 0;  // 0 while nothing is cached
+    };
+
+    std::vector<Stage> _stages;
+    cv::Mat _source;
+    uint64_t _sourceGeneration = 0;
+    uint64_t _nextGeneration = 0;
+
+    uint64_t _inputGeneration(StageId id) const;
+    cv::Mat _inputOf(StageId id);
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,257 @@
+#include "RegionStats.h"
+#include "Kernels.h"
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+int floorLog2(int v)
+{
+    int l = 0;
+    while (v >>= 1) l++;
+    return l;
+}
+
+} // namespace
+
+void RegionStatsIndex::clear()
+{
+    _gray.release();
+    _blocksX = _blocksY = _stride = 0;
+    _sum = std::vector<uint64_t>();
+    _sqsum = std::vector<uint64_t>();
+    _nonzero = std::vector<uint64_t>();
+    _levelsX = _levelsY = 0;
+    _minTable.clear();
+    _maxTable.clear();
+}
+
+size_t RegionStatsIndex::bytes() const
+{
+    size_t tables = 0;
+    for (size_t i = 0; i < _minTable.size(); i++)
+        tables += _minTable[i].total() + _maxTable[i].total();
+    return (_sum.capacity() + _sqsum.capacity() + _nonzero.capacity()) * sizeof(uint64_t) + tables;
+}
+
+void RegionStatsIndex::build(const cv::Mat &image)
+{
+    clear();
+    if (image.empty() || image.depth() != CV_8U || (image.channels() != 1 && image.channels() != 3))
+        return;
+    maxChannelGray(image, _gray);
+
+    const int w = _gray.cols, h = _gray.rows;
+    _blocksX = (w + Block - 1) / Block;
+    _blocksY = (h + Block - 1) / Block;
+    _stride = _blocksX + 1;
+    _sum.assign(size_t(_stride) * (_blocksY + 1), 0);
+    _sqsum.assign(size_t(_stride) * (_blocksY + 1), 0);
+    _nonzero.assign(size_t(_stride) * (_blocksY + 1), 0);
+    cv::Mat blockMin(_blocksY, _blocksX, CV_8UC1);
+    cv::Mat blockMax(_blocksY, _blocksX, CV_8UC1);
+
+    // Every block on its own, one row of blocks per task. Its values go where the
+    // integral of its bottom right corner will be.
+    cv::parallel_for_(cv::Range(0, _blocksY), [&](const cv::Range &range) {
+        std::vector<uint32_t> sum(_blocksX), sqsum(_blocksX), nonzero(_blocksX);
+        for (int by = range.start; by < range.end; by++) {
+            std::fill(sum.begin(), sum.end(), 0);
+            std::fill(sqsum.begin(), sqsum.end(), 0);
+            std::fill(nonzero.begin(), nonzero.end(), 0);
+            uchar *bmin = blockMin.ptr<uchar>(by);
+            uchar *bmax = blockMax.ptr<uchar>(by);
+            std::fill(bmin, bmin + _blocksX, 255);
+            std::fill(bmax, bmax + _blocksX, 0);
+            for (int y = by * Block; y < std::min(h, (by + 1) * Block); y++) {
+                const uchar *p = _gray.ptr<uchar>(y);
+                for (int x = 0; x < w; x++) {
+                    const int b = x / Block;
+                    sum[b] += p[x];
+                    sqsum[b] += uint32_t(p[x]) * p[x];
+                    nonzero[b] += p[x] != 0;
+                    bmin[b] = std::min(bmin[b], p[x]);
+                    bmax[b] = std::max(bmax[b], p[x]);
+                }
+            }
+            const size_t row = size_t(by + 1) * _stride + 1;
+            std::copy(sum.begin(), sum.end(), _sum.begin() + row);
+            std::copy(sqsum.begin(), sqsum.end(), _sqsum.begin() + row);
+            std::copy(nonzero.begin(), nonzero.end(), _nonzero.begin() + row);
+        }
+    }, std::max(1.0, _gray.total() / 65536.0));
+
+    // Integrals over the blocks, a few per 256 pixels: sequential is enough
+    for (int by = 1; by <= _blocksY; by++) {
+        const size_t above = size_t(by - 1) * _stride, row = size_t(by) * _stride;
+        for (int bx = 1; bx <= _blocksX; bx++) {
+            _sum[row + bx] += _sum[row + bx - 1] + _sum[above + bx] - _sum[above + bx - 1];
+            _sqsum[row + bx] += _sqsum[row + bx - 1] + _sqsum[above + bx] - _sqsum[above + bx - 1];
+            _nonzero[row + bx] += _nonzero[row + bx - 1] + _nonzero[above + bx] - _nonzero[above + bx - 1];
+        }
+    }
+
+    // Each level is the min or max of two overlapping halves of a smaller one
+    _levelsX = floorLog2(_blocksX) + 1;
+    _levelsY = floorLog2(_blocksY) + 1;
+    _minTable.resize(size_t(_levelsX) * _levelsY);
+    _maxTable.resize(size_t(_levelsX) * _levelsY);
+    for (int ly = 0; ly < _levelsY; ly++) {
+        for (int lx = 0; lx < _levelsX; lx++) {
+            cv::Mat &mn = _minTable[ly * _levelsX + lx];
+            cv::Mat &mx = _maxTable[ly * _levelsX + lx];
+            if (ly == 0 && lx == 0) {
+                mn = blockMin;
+                mx = blockMax;
+            } else if (lx > 0) {
+                const cv::Mat &pmin = _minTable[ly * _levelsX + lx - 1];
+                const cv::Mat &pmax = _maxTable[ly * _levelsX + lx - 1];
+                const int half = 1 << (lx - 1), cols = pmin.cols - half;
+                cv::min(pmin.colRange(0, cols), pmin.colRange(half, half + cols), mn);
+                cv::max(pmax.colRange(0, cols), pmax.colRange(half, half + cols), mx);
+            } else {
+                const cv::Mat &pmin = _minTable[(ly - 1) * _levelsX];
+                const cv::Mat &pmax = _maxTable[(ly - 1) * _levelsX];
+                const int half = 1 << (ly - 1), rows = pmin.rows - half;
+                cv::min(pmin.rowRange(0, rows), pmin.rowRange(half, half + rows), mn);
+                cv::max(pmax.rowRange(0, rows), pmax.rowRange(half, half + rows), mx);
+            }
+        }
+    }
+}
+
+void RegionStatsIndex::_addBlocks(int by0, int by1, int bx0, int bx1, Accumulator &acc) const
+{
+    const size_t top = size_t(by0) * _stride, bottom = size_t(by1) * _stride;
+    acc.sum += _sum[bottom + bx1] - _sum[bottom + bx0] - _sum[top + bx1] + _sum[top + bx0];
+    acc.sqsum += _sqsum[bottom + bx1] - _sqsum[bottom + bx0] - _sqsum[top + bx1] + _sqsum[top + bx0];
+    acc.nonzero += _nonzero[bottom + bx1] - _nonzero[bottom + bx0] - _nonzero[top + bx1] + _nonzero[top + bx0];
+    acc.count += uint64_t(std::min(_gray.rows, by1 * Block) - by0 * Block)
+               * (std::min(_gray.cols, bx1 * Block) - bx0 * Block);
+
+    // Four overlapping squares of the sparse table cover the range
+    const int ly = floorLog2(by1 - by0), lx = floorLog2(bx1 - bx0);
+    const cv::Mat &mn = _minTable[ly * _levelsX + lx];
+    const cv::Mat &mx = _maxTable[ly * _levelsX + lx];
+    const int by = by1 - (1 << ly), bx = bx1 - (1 << lx);
+    acc.min = std::min({acc.min, int(mn.at<uchar>(by0, bx0)), int(mn.at<uchar>(by0, bx)),
+                        int(mn.at<uchar>(by, bx0)), int(mn.at<uchar>(by, bx))});
+    acc.max = std::max({acc.max, int(mx.at<uchar>(by0, bx0)), int(mx.at<uchar>(by0, bx)),
+                        int(mx.at<uchar>(by, bx0)), int(mx.at<uchar>(by, bx))});
+}
+
+void RegionStatsIndex::_addPixels(int y, int x0, int x1, Accumulator &acc) const
+{
+    if (x0 >= x1) return;
+    const uchar *p = _gray.ptr<uchar>(y);
+    for (int x = x0; x < x1; x++) {
+        acc.sum += p[x];
+        acc.sqsum += uint32_t(p[x]) * p[x];
+        acc.nonzero += p[x] != 0;
+        acc.min = std::min<int>(acc.min, p[x]);
+        acc.max = std::max<int>(acc.max, p[x]);
+    }
+    acc.count += x1 - x0;
+}
+
+RegionStats RegionStatsIndex::_finish(const Accumulator &acc)
+{
+    RegionStats stats;
+    if (acc.count == 0)
+        return stats;
+    stats.count = acc.count;
+    stats.mean = double(acc.sum) / acc.count;
+    stats.stddev = std::sqrt(std::max(0.0, double(acc.sqsum) / acc.count - stats.mean * stats.mean));
+    stats.min = acc.min;
+    stats.max = acc.max;
+    stats.foreground = double(acc.nonzero) / acc.count;
+    return stats;
+}
+
+RegionStats RegionStatsIndex::rect(const cv::Rect &rect) const
+{
+    if (empty())
+        return RegionStats();
+    const int w = _gray.cols, h = _gray.rows;
+    cv::Rect r = rect & cv::Rect(0, 0, w, h);
+    Accumulator acc;
+    if (r.empty())
+        return _finish(acc);
+
+    // Blocks entirely inside, the partial ones at the image border when the rectangle reaches it
+    const int x0 = r.x, x1 = r.x + r.width, y0 = r.y, y1 = r.y + r.height;
+    const int bx0 = (x0 + Block - 1) / Block, bx1 = x1 == w ? _blocksX : x1 / Block;
+    const int by0 = (y0 + Block - 1) / Block, by1 = y1 == h ? _blocksY : y1 / Block;
+    if (bx0 >= bx1 || by0 >= by1) {
+        for (int y = y0; y < y1; y++)
+            _addPixels(y, x0, x1, acc);
+        return _finish(acc);
+    }
+
+    _addBlocks(by0, by1, bx0, bx1, acc);
+    const int ix0 = bx0 * Block, ix1 = std::min(w, bx1 * Block);
+    const int iy0 = by0 * Block, iy1 = std::min(h, by1 * Block);
+    for (int y = y0; y < y1; y++) {
+        if (y < iy0 || y >= iy1) {
+            _addPixels(y, x0, x1, acc);
+        } else {
+            _addPixels(y, x0, ix0, acc);
+            _addPixels(y, ix1, x1, acc);
+        }
+    }
+    return _finish(acc);
+}
+
+RegionStats RegionStatsIndex::circle(const cv::Point &center, int radius) const
+{
+    if (empty() || radius < 0)
+        return RegionStats();
+
+    const int w = _gray.cols, h = _gray.rows;
+    auto span = [&](int y, int &x0, int &x1) {
+        const int dy = y - center.y;
+        const int half = static_cast<int>(std::sqrt(double(radius) * radius - double(dy) * dy));
+        x0 = std::max(0, center.x - half);
+        x1 = std::min(w, center.x + half + 1);
+    };
+
+    Accumulator acc;
+    const int y0 = std::max(0, center.y - radius);
+    const int y1 = std::min(h, center.y + radius + 1);
+    // One band of block rows at a time: blocks inside the spans of all its rows count
+    // as a whole, the rest of each row pixel by pixel
+    for (int by = y0 / Block; by * Block < y1; by++) {
+        const int band0 = by * Block, band1 = std::min(h, band0 + Block);
+        const int r0 = std::max(band0, y0), r1 = std::min(band1, y1);
+        int bx0 = 0, bx1 = 0;
+        if (r0 == band0 && r1 == band1) {
+            int ix0 = 0, ix1 = w, x0, x1;
+            for (int y = r0; y < r1; y++) {
+                span(y, x0, x1);
+                ix0 = std::max(ix0, x0);
+                ix1 = std::min(ix1, x1);
+            }
+            if (ix0 < ix1) {
+                bx0 = (ix0 + Block - 1) / Block;
+                bx1 = ix1 == w ? _blocksX : ix1 / Block;
+            }
+        }
+
+        const bool blocks = bx0 < bx1;
+        if (blocks)
+            _addBlocks(by, by + 1, bx0, bx1, acc);
+        const int inner0 = bx0 * Block, inner1 = std::min(w, bx1 * Block);
+        for (int y = r0; y < r1; y++) {
+            int x0, x1;
+            span(y, x0, x1);
+            if (blocks) {
+                _addPixels(y, x0, inner0, acc);
+                _addPixels(y, inner1, x1, acc);
+            } else {
+                _addPixels(y, x0, x1, acc);
+            }
+        }
+    }
+    return _finish(acc);
+}
@@ -0,0 +1,62 @@
+#ifndef REGIONSTATS_H
+#define REGIONSTATS_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+// Statistics of the gray levels under a shape
+struct RegionStats {
+    size_t count = 0;           // pixels inside both the shape and the image
+    double mean = 0;
+    double stddev = 0;
+    int min = 0;
+    int max = 0;
+    double foreground = 0;      // fraction of non zero pixels
+};
+
+// Per block statistics of one image, built once, then queried while a shape is dragged.
+// The 16x16 blocks entirely inside the shape cost O(1): integrals of their sums, and 2-D
+// sparse tables of their min and max. That is one lookup per rectangle, and one per band
+// of 16 rows of a circle. The pixels of partly covered blocks along the edge are read
+// directly, so a query is O(perimeter x 16). Less than 2 bytes per pixel, gray copy included.
+class RegionStatsIndex
+{
+public:
+    // Color images are reduced to their max channel, like the threshold does
+    void build(const cv::Mat &image);
+    void clear();
+    bool empty() const { return _gray.empty(); }
+    // Block integrals and tables, the gray image excluded
+    size_t bytes() const;
+
+    RegionStats rect(const cv::Rect &rect) const;
+    RegionStats circle(const cv::Point &center, int radius) const;
+
+private:
+    static constexpr int Block = 16;
+
+    cv::Mat _gray;
+    int _blocksX = 0, _blocksY = 0;  // partial blocks at the right and bottom included
+    int _stride = 0;                 // integral row length, _blocksX + 1
+    std::vector<uint64_t> _sum;      // integrals over whole blocks
+    std::vector<uint64_t> _sqsum;
+    std::vector<uint64_t> _nonzero;
+    // Sparse tables: level (ly, lx), at ly * _levelsX + lx, holds the min and max
+    // of the 2^ly x 2^lx blocks starting at each block
+    int _levelsX = 0, _levelsY = 0;
+    std::vector<cv::Mat> _minTable;
+    std::vector<cv::Mat> _maxTable;
+
+    struct Accumulator {
+        uint64_t sum = 0, sqsum = 0, nonzero = 0, count = 0;
+        int min = 255, max = 0;
+    };
+    // Blocks rows [by0, by1) and columns [bx0, bx1), not empty
+    void _addBlocks(int by0, int by1, int bx0, int bx1, Accumulator &acc) const;
+    // Pixels [x0, x1) of row y, already clipped to the image
+    void _addPixels(int y, int x0, int x1, Accumulator &acc) const;
+    static RegionStats _finish(const Accumulator &acc);
+};
+
+#endif // REGIONSTATS_H
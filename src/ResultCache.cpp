@@ -0,0 +1,344 @@
+#include "ResultCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+const char Magic[4] = {'P', 'T', 'R', 'C'};
+const uint32_t Version = 1;
+
+template <typename T>
+void put(std::vector<char> &out, const T &value)
+{
+    const char *p = reinterpret_cast<const char *>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void putMat(std::vector<char> &out, const cv::Mat &m, int type)
+{
+    cv::Mat c = m.empty() ? m : (m.isContinuous() ? m : m.clone());
+    put(out, static_cast<uint32_t>(c.rows));
+    put(out, static_cast<uint32_t>(c.cols));
+    if (!c.empty()) {
+        CV_Assert(c.type() == type);
+        out.insert(out.end(), c.ptr<char>(), c.ptr<char>() + c.total() * c.elemSize());
+    }
+}
+
+// Bounds checked reads, any short read marks the file invalid
+struct Reader {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    template <typename T>
+    T get()
+    {
+        T value{};
+        if (end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    cv::Mat getMat(int type)
+    {
+        uint32_t rows = get<uint32_t>(), cols = get<uint32_t>();
+        if (!ok || rows == 0 || cols == 0)
+            return cv::Mat();
+        size_t bytes = size_t(rows) * cols * CV_ELEM_SIZE(type);
+        if (static_cast<size_t>(end - p) < bytes) {
+            ok = false;
+            return cv::Mat();
+        }
+        cv::Mat m(rows, cols, type);
+        std::memcpy(m.data, p, bytes);
+        p += bytes;
+        return m;
+    }
+};
+
+} // namespace
+
+void CacheKey::_word(uint64_t k)
+{
+    k *= 0x87c37b91114253d5ULL;
+    k = rotl(k, 31);
+    k *= 0x4cf5ad432745937fULL;
+    _h ^= k;
+    _h = rotl(_h, 27) * 5 + 0x52dce729;
+    _length += 8;
+}
+
+CacheKey &CacheKey::add(const cv::Mat &m)
+{
+    _word(static_cast<uint64_t>(m.rows) << 32 | static_cast<uint32_t>(m.cols));
+    _word(static_cast<uint64_t>(m.type()));
+    const size_t rowBytes = m.cols * m.elemSize();
+    for (int y = 0; y < m.rows; y++) {
+        const uchar *p = m.ptr<uchar>(y);
+        size_t x = 0;
+        for (; x + 8 <= rowBytes; x += 8) {
+            uint64_t k;
+            std::memcpy(&k, p + x, 8);
+            _word(k);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + x, rowBytes - x);
+        _word(tail);
+    }
+    return *this;
+}
+
+CacheKey &CacheKey::add(const std::string &s)
+{
+    _word(s.size());
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+        uint64_t k;
+        std::memcpy(&k, s.data() + i, 8);
+        _word(k);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, s.data() + i, s.size() - i);
+    _word(tail);
+    return *this;
+}
+
+CacheKey &CacheKey::add(double v)
+{
+    uint64_t k;
+    std::memcpy(&k, &v, 8);
+    _word(k);
+    return *this;
+}
+
+CacheKey &CacheKey::add(int64_t v)
+{
+    _word(static_cast<uint64_t>(v));
+    return *this;
+}
+
+CacheKey &CacheKey::add(const HoughParams &p, circleDetector detector)
+{
+    add(int64_t(detector)).add(p.minDist).add(int64_t(p.minRadius)).add(int64_t(p.maxRadius));
+    // Blobs need neither the accumulator nor the edges, only the shape test
+    if (detector == BLOB_DETECTOR)
+        return add(p.minCircularity);
+    return add(p.dp).add(p.param1).add(p.param2);
+}
+
+uint64_t CacheKey::value() const
+{
+    return fmix(_h ^ _length);
+}
+
+bool ResultCache::open(const fs::path &dir, uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dir.clear();
+    _files.clear();
+    _total = 0;
+    _budget = budget;
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec))
+        return false;
+
+    // Files of previous sessions, ordered by their last use
+    std::vector<std::pair<fs::file_time_type, std::pair<uint64_t, uint64_t>>> found;
+    for (const auto &item : fs::directory_iterator(dir, ec)) {
+        if (!item.is_regular_file() || item.path().extension() != ".res")
+            continue;
+        const std::string stem = item.path().stem().string();
+        char *end = nullptr;
+        uint64_t key = std::strtoull(stem.c_str(), &end, 16);
+        if (stem.empty() || *end != '\0')
+            continue;
+        std::error_code fileEc;
+        uint64_t bytes = item.file_size(fileEc);
+        fs::file_time_type time = item.last_write_time(fileEc);
+        if (!fileEc)
+            found.push_back({time, {key, bytes}});
+    }
+    std::sort(found.begin(), found.end());
+    for (const auto &f : found) {
+        _files[f.second.first] = {f.second.second, ++_clock};
+        _total += f.second.second;
+    }
+
+    _dir = dir;
+    _evict();
+    return true;
+}
+
+void ResultCache::setBudget(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = bytes;
+    _evict();
+}
+
+fs::path ResultCache::_path(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.res", static_cast<unsigned long long>(key));
+    return _dir / name;
+}
+
+bool ResultCache::load(uint64_t key, Entry &entry)
+{
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_dir.empty() || !_files.count(key))
+            return false;
+        path = _path(key);
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    Reader r{data.data(), data.data() + data.size()};
+
+    bool valid = data.size() >= sizeof(Magic) && std::memcmp(data.data(), Magic, sizeof(Magic)) == 0;
+    Entry loaded;
+    if (valid) {
+        r.p += sizeof(Magic);
+        valid = r.get<uint32_t>() == Version && r.get<uint64_t>() == key && r.ok;
+    }
+    if (valid) {
+        uint32_t count = r.get<uint32_t>();
+        if (r.ok && static_cast<size_t>(r.end - r.p) >= size_t(count) * sizeof(cv::Vec3f)) {
+            loaded.circles.resize(count);
+            std::memcpy(loaded.circles.data(), r.p, count * sizeof(cv::Vec3f));
+            r.p += count * sizeof(cv::Vec3f);
+        } else
+            r.ok = false;
+        loaded.stats = r.getMat(CV_32S);
+        loaded.centroids = r.getMat(CV_64F);
+        valid = r.ok;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _files.find(key);
+    if (!valid) {
+        // Truncated or from another version: forget it
+        std::error_code ec;
+        fs::remove(path, ec);
+        if (it != _files.end()) {
+            _total -= it->second.bytes;
+            _files.erase(it);
+        }
+        return false;
+    }
+    if (it != _files.end())
+        it->second.lastUse = ++_clock;
+    // The next sessions order files by modification time
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    entry = std::move(loaded);
+    return true;
+}
+
+void ResultCache::store(uint64_t key, const Entry &entry)
+{
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_dir.empty())
+            return;
+        path = _path(key);
+    }
+
+    std::vector<char> data(Magic, Magic + sizeof(Magic));
+    put(data, Version);
+    put(data, key);
+    put(data, static_cast<uint32_t>(entry.circles.size()));
+    const char *circles = reinterpret_cast<const char *>(entry.circles.data());
+    data.insert(data.end(), circles, circles + entry.circles.size() * sizeof(cv::Vec3f));
+    putMat(data, entry.stats, CV_32S);
+    putMat(data, entry.centroids, CV_64F);
+
+    // Written aside then renamed, readers never see a partial file
+    fs::path tmp = path;
+    tmp += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(data.data(), data.size());
+        if (!out) {
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    File &file = _files[key];
+    _total = _total - file.bytes + data.size();
+    file.bytes = data.size();
+    file.lastUse = ++_clock;
+    _evict();
+}
+
+void ResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::error_code ec;
+    for (const auto &f : _files)
+        fs::remove(_path(f.first), ec);
+    _files.clear();
+    _total = 0;
+}
+
+void ResultCache::_evict()
+{
+    if (_total <= _budget)
+        return;
+    std::vector<std::pair<uint64_t, uint64_t>> byUse;   // last use, key
+    byUse.reserve(_files.size());
+    for (const auto &f : _files)
+        byUse.push_back({f.second.lastUse, f.first});
+    std::sort(byUse.begin(), byUse.end());
+
+    std::error_code ec;
+    for (const auto &u : byUse) {
+        if (_total <= _budget)
+            break;
+        auto it = _files.find(u.second);
+        fs::remove(_path(it->first), ec);
+        _total -= it->second.bytes;
+        _files.erase(it);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Params.h"
+
+// 64 bit fingerprint of the inputs of an operation: image content, parameters, mask.
+// Stable across runs and machines of the same endianness, so it can name files.
+class CacheKey
+{
+public:
+    explicit CacheKey(const std::string &operation) { add(operation); }
+
+    CacheKey &add(const cv::Mat &m);        // size, type and pixels
+    CacheKey &add(const std::string &s);
+    CacheKey &add(double v);
+    CacheKey &add(int64_t v);
+    // The detector and only the parameters it reads, so changing an unused one keeps the key
+    CacheKey &add(const HoughParams &p, circleDetector detector);
+    uint64_t value() const;
+
+private:
+    uint64_t _h = 0x9e3779b97f4a7c15ULL;
+    uint64_t _length = 0;
+    void _word(uint64_t k);
+};
+
+// Detection results kept on disk between sessions, one small binary file per key.
+// The least recently used files go first once the directory exceeds its budget.
+// Safe to use from several threads.
+class ResultCache
+{
+public:
+    struct Entry {
+        std::vector<cv::Vec3f> circles;
+        cv::Mat stats;          // connected components, CV_32S
+        cv::Mat centroids;      // CV_64F
+    };
+
+    // Creates the directory if needed and indexes the files already there.
+    // Returns false, leaving the cache disabled, when the directory cannot be used.
+    bool open(const std::filesystem::path &dir, uint64_t budget);
+    bool isOpen() const { return !_dir.empty(); }
+    void setBudget(uint64_t bytes);
+
+    bool load(uint64_t key, Entry &entry);
+    void store(uint64_t key, const Entry &entry);
+    void clear();
+
+private:
+    struct File {
+        uint64_t bytes = 0;
+        uint64_t lastUse = 0;   // ordering only, bumped on every hit
+    };
+
+    std::mutex _mutex;
+    std::filesystem::path _dir;
+    uint64_t _budget = 0;
+    uint64_t _total = 0;
+    uint64_t _clock = 0;
+    std::map<uint64_t, File> _files;
+
+    std::filesystem::path _path(uint64_t key) const;
+    void _evict();
+};
+
+#endif // RESULTCACHE_H
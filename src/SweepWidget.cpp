@@ -0,0 +1,137 @@
+#include "SweepWidget.h"
+#include <QPainter>
+#include <QMouseEvent>
+#include <QToolTip>
+#include <algorithm>
+#include <cmath>
+
+static const int AxisMargin = 28;   // room for the axis labels, left and top
+
+SweepWidget::SweepWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(160);
+    setMouseTracking(true);
+    setToolTip("Rows: param1 - Columns: param2\nClick a cell to use its parameters");
+}
+
+void SweepWidget::setSweep(const std::vector<double> &param1Values, const std::vector<double> &param2Values,
+                           const cv::Mat &counts)
+{
+    CV_Assert(counts.type() == CV_32S && counts.rows == (int)param1Values.size()
+              && counts.cols == (int)param2Values.size());
+    _param1 = param1Values;
+    _param2 = param2Values;
+    _counts = counts;
+    update();
+}
+
+void SweepWidget::setExpected(int expected)
+{
+    if (expected == _expected) return;
+    _expected = expected;
+    update();
+}
+
+void SweepWidget::setCurrent(double param1, double param2)
+{
+    _currentParam1 = param1;
+    _currentParam2 = param2;
+    update();
+}
+
+void SweepWidget::clear()
+{
+    _param1.clear();
+    _param2.clear();
+    _counts = cv::Mat();
+    update();
+}
+
+QRectF SweepWidget::_grid() const
+{
+    return QRectF(AxisMargin, AxisMargin / 2, width() - AxisMargin - 1, height() - AxisMargin / 2 - 1);
+}
+
+bool SweepWidget::_cellAt(const QPointF &pos, int &row, int &col) const
+{
+    if (_counts.empty()) return false;
+    QRectF grid = _grid();
+    if (!grid.contains(pos)) return false;
+    col = std::min(_counts.cols - 1, (int)((pos.x() - grid.left()) * _counts.cols / grid.width()));
+    row = std::min(_counts.rows - 1, (int)((pos.y() - grid.top()) * _counts.rows / grid.height()));
+    return true;
+}
+
+// Counts: dark to bright. Error to the expected count: green when exact, to red.
+QColor SweepWidget::_color(int count, int maxValue) const
+{
+    if (count < 0) return QColor(60, 60, 60);
+    if (_expected > 0) {
+        double error = std::min(1.0, std::abs(count - _expected) / (double)_expected);
+        return QColor::fromHsvF((1.0 - error) / 3.0, 0.8, 0.9);
+    }
+    double v = maxValue > 0 ? std::log1p(count) / std::log1p(maxValue) : 0.0;
+    return QColor::fromHsvF(0.66 * (1.0 - v), 0.8, 0.3 + 0.7 * v);
+}
+
+void SweepWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(40, 40, 40));
+    if (_counts.empty()) return;
+
+    double maxCount = 0;
+    cv::minMaxLoc(_counts, nullptr, &maxCount);
+
+    QRectF grid = _grid();
+    double cw = grid.width() / _counts.cols;
+    double ch = grid.height() / _counts.rows;
+    QFont font = painter.font();
+    font.setPixelSize(std::clamp((int)std::min(cw, ch) / 3, 7, 11));
+    painter.setFont(font);
+
+    for (int r = 0; r < _counts.rows; r++) {
+        for (int c = 0; c < _counts.cols; c++) {
+            int count = _counts.at<int>(r, c);
+            QRectF cell(grid.left() + c * cw, grid.top() + r * ch, cw, ch);
+            QColor color = _color(count, (int)maxCount);
+            painter.fillRect(cell, color);
+            if (count >= 0) {
+                painter.setPen(color.lightnessF() > 0.5 ? Qt::black : Qt::white);
+                painter.drawText(cell, Qt::AlignCenter, QString::number(count));
+            }
+            if (_param1[r] == _currentParam1 && _param2[c] == _currentParam2) {
+                painter.setPen(QPen(Qt::white, 2));
+                painter.drawRect(cell.adjusted(1, 1, -1, -1));
+            }
+        }
+    }
+
+    // Axis labels: param1 on the left, param2 on top
+    painter.setPen(QColor(200, 200, 200));
+    for (int r = 0; r < _counts.rows; r++)
+        painter.drawText(QRectF(0, grid.top() + r * ch, AxisMargin - 2, ch),
+                         Qt::AlignRight | Qt::AlignVCenter, QString::number(_param1[r], 'g', 3));
+    for (int c = 0; c < _counts.cols; c++)
+        painter.drawText(QRectF(grid.left() + c * cw, 0, cw, grid.top()),
+                         Qt::AlignCenter, QString::number(_param2[c], 'g', 3));
+}
+
+void SweepWidget::mousePressEvent(QMouseEvent *event)
+{
+    int row, col;
+    if (_cellAt(event->position(), row, col))
+        emit paramsPicked(_param1[row], _param2[col]);
+}
+
+void SweepWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    int row, col;
+    if (!_cellAt(event->position(), row, col)) return;
+    int count = _counts.at<int>(row, col);
+    QString text = QString("param1 %1, param2 %2: %3 circles")
+                       .arg(_param1[row]).arg(_param2[col])
+                       .arg(count < 0 ? QString("-") : QString::number(count));
+    QToolTip::showText(event->globalPosition().toPoint(), text, this);
+}
@@ -0,0 +1,46 @@
+#ifndef SWEEPWIDGET_H
+#define SWEEPWIDGET_H
+
+#include <QWidget>
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Heatmap of a Hough parameter sweep: param1 along rows, param2 along columns.
+// Cells show the circle count, or its distance to the expected count when one is set.
+class SweepWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SweepWidget(QWidget *parent = nullptr);
+
+    void setSweep(const std::vector<double> &param1Values, const std::vector<double> &param2Values,
+                  const cv::Mat &counts);
+    // 0 shows raw counts
+    void setExpected(int expected);
+    void setCurrent(double param1, double param2);
+    void clear();
+
+signals:
+    // Parameters of the clicked cell
+    void paramsPicked(double param1, double param2);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+    std::vector<double> _param1;
+    std::vector<double> _param2;
+    cv::Mat _counts;            // CV_32S, -1 when not computed
+    int _expected = 0;
+    double _currentParam1 = -1;
+    double _currentParam2 = -1;
+
+    QRectF _grid() const;
+    bool _cellAt(const QPointF &pos, int &row, int &col) const;
+    QColor _color(int count, int maxValue) const;
+};
+
+#endif // SWEEPWIDGET_H
@@ -0,0 +1,195 @@
+#include "TilePyramid.h"
+#include "Trace.h"
+#include <QThread>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+TilePyramid::TilePyramid(QObject *parent)
+    : QObject(parent)
+{
+    _pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+TilePyramid::~TilePyramid()
+{
+    // Workers post tiles to this object, make sure none is still running
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void TilePyramid::clear()
+{
+    _pool.clear();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _generation++;
+    _image = QImage();
+    _lru.clear();
+    _tiles.clear();
+    _pending.clear();
+    _bytes = 0;
+}
+
+void TilePyramid::setImage(const QImage &image)
+{
+    clear();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _image = image;
+    }
+    // The single-tile level is the fallback while finer tiles are being built
+    if (!image.isNull() && maxLevel() > 0)
+        _request({maxLevel(), 0, 0});
+}
+
+int TilePyramid::levelFor(double scale)
+{
+    if (scale >= 1.0) return 0;
+    return static_cast<int>(std::floor(std::log2(1.0 / scale)));
+}
+
+int TilePyramid::maxLevel() const
+{
+    int size = std::max(_image.width(), _image.height());
+    int level = 0;
+    while ((size >> level) > TileSize)
+        level++;
+    return level;
+}
+
+size_t TilePyramid::cacheBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+QImage TilePyramid::_cached(const Key &key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _tiles.find(key);
+    if (it == _tiles.end())
+        return QImage();
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return it->second->second;
+}
+
+QImage TilePyramid::_tile(const Key &key)
+{
+    QImage tile = _cached(key);
+    if (tile.isNull())
+        _request(key);
+    return tile;
+}
+
+void TilePyramid::_request(const Key &key)
+{
+    quint64 generation;
+    QImage image;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tiles.count(key) || !_pending.insert(key).second)
+            return;
+        generation = _generation;
+        image = _image;
+    }
+    _pool.start([this, generation, image, key]() {
+        _store(generation, key, _buildTile(image, key));
+        emit tileReady();
+    });
+}
+
+void TilePyramid::_store(quint64 generation, const Key &key, const QImage &tile)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (generation != _generation)
+        return;
+    _pending.erase(key);
+    _lru.emplace_front(key, tile);
+    _tiles[key] = _lru.begin();
+    _bytes += tile.sizeInBytes();
+
+    // Least recently drawn tiles go first
+    while (_bytes > _budget && _lru.size() > 1) {
+        _bytes -= _lru.back().second.sizeInBytes();
+        _tiles.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+}
+
+QImage TilePyramid::_buildTile(const QImage &image, const Key &key)
+{
+    TRACE_SCOPE("TilePyramid::_buildTile");
+    const int factor = 1 << key.level;
+    const int span = TileSize * factor;
+    QRect base = QRect(key.tx * span, key.ty * span, span, span) & image.rect();
+    if (base.isEmpty())
+        return QImage();
+
+    int type = CV_8UC(image.depth() / 8);
+    cv::Mat src(image.height(), image.width(), type,
+                const_cast<uchar*>(image.constBits()), image.bytesPerLine());
+
+    QImage tile((base.width() + factor - 1) / factor, (base.height() + factor - 1) / factor, image.format());
+    cv::Mat dst(tile.height(), tile.width(), type, tile.bits(), tile.bytesPerLine());
+    cv::resize(src(cv::Rect(base.x(), base.y(), base.width(), base.height())), dst,
+               dst.size(), 0, 0, cv::INTER_AREA);
+    return tile;
+}
+
+void TilePyramid::draw(QPainter &painter, const QRect &viewport, const QPointF &offset, double scale)
+{
+    if (_image.isNull())
+        return;
+
+    // Visible part of the image, in image pixels
+    QRectF visible((viewport.left() - offset.x()) / scale, (viewport.top() - offset.y()) / scale,
+                   viewport.width() / scale, viewport.height() / scale);
+    QRect region = visible.toAlignedRect() & _image.rect();
+    if (region.isEmpty())
+        return;
+
+    // Image rect to widget rect, rounded so that neighbouring tiles share their edges
+    auto toWidget = [&](const QRect &r) {
+        int left   = std::lround(r.left() * scale + offset.x());
+        int top    = std::lround(r.top() * scale + offset.y());
+        int right  = std::lround((r.left() + r.width()) * scale + offset.x());
+        int bottom = std::lround((r.top() + r.height()) * scale + offset.y());
+        return QRect(left, top, right - left, bottom - top);
+    };
+
+    int level = std::min(levelFor(scale), maxLevel());
+    if (level == 0) {
+        painter.drawImage(toWidget(region), _image, region);
+        return;
+    }
+
+    const int span = TileSize << level;
+    for (int ty = region.top() / span; ty <= region.bottom() / span; ty++) {
+        for (int tx = region.left() / span; tx <= region.right() / span; tx++) {
+            QRect base = QRect(tx * span, ty * span, span, span) & _image.rect();
+            QRect target = toWidget(base);
+
+            QImage tile = _tile({level, tx, ty});
+            if (!tile.isNull()) {
+                painter.drawImage(target, tile);
+                continue;
+            }
+
+            // Not built yet: use the part of a coarser tile already in cache
+            bool drawn = false;
+            for (int l = level + 1; l <= maxLevel() && !drawn; l++) {
+                const int s = TileSize << l;
+                const double f = 1 << l;
+                Key key{l, base.x() / s, base.y() / s};
+                QImage coarse = _cached(key);
+                if (coarse.isNull()) continue;
+                QRectF source((base.x() - key.tx * s) / f, (base.y() - key.ty * s) / f,
+                              base.width() / f, base.height() / f);
+                painter.drawImage(QRectF(target), coarse, source);
+                drawn = true;
+            }
+            if (!drawn)
+                painter.drawImage(target, _image, base);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef TILEPYRAMID_H
+#define TILEPYRAMID_H
+
+#include <QObject>
+#include <QImage>
+#include <QPainter>
+#include <QThreadPool>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+// Tiled mip pyramid of the displayed image.
+// Level 0 is the image itself, level n is downscaled by 2^n. Only the tiles visible
+// at the level best matching the zoom are drawn, so the cost of a repaint depends
+// on the widget size rather than on the image size. Downscaled tiles are built
+// lazily on a background thread and kept in a bounded LRU cache.
+class TilePyramid : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int TileSize = 256;
+
+    explicit TilePyramid(QObject *parent = nullptr);
+    ~TilePyramid();
+
+    void setImage(const QImage &image);
+    // Drops the image and every tile built from it
+    void clear();
+
+    // Finest level not finer than the screen at this zoom
+    static int levelFor(double scale);
+    int maxLevel() const;
+    // Memory held by the tile cache
+    size_t cacheBytes() const;
+
+    // Draws the part of the image visible in `viewport`, image pixel (0, 0) being at `offset`
+    void draw(QPainter &painter, const QRect &viewport, const QPointF &offset, double scale);
+
+signals:
+    // Emitted from the worker thread when a tile becomes available
+    void tileReady();
+
+private:
+    struct Key {
+        int level;
+        int tx;
+        int ty;
+        bool operator==(const Key &o) const { return level == o.level && tx == o.tx && ty == o.ty; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            return (static_cast<size_t>(k.level) << 48) ^ (static_cast<size_t>(k.tx) << 24) ^ static_cast<size_t>(k.ty);
+        }
+    };
+    using LruList = std::list<std::pair<Key, QImage>>;
+
+    QImage _image;
+    quint64 _generation = 0;
+    QThreadPool _pool;
+
+    mutable std::mutex _mutex;  // guards the cache, filled from the workers
+    LruList _lru;
+    std::unordered_map<Key, LruList::iterator, KeyHash> _tiles;
+    std::unordered_set<Key, KeyHash> _pending;
+    size_t _bytes = 0;
+    size_t _budget = 128u << 20;
+
+    QImage _tile(const Key &key);      // schedules the tile if missing
+    QImage _cached(const Key &key);
+    void _request(const Key &key);
+    void _store(quint64 generation, const Key &key, const QImage &tile);
+    static QImage _buildTile(const QImage &image, const Key &key);
+};
+
+#endif // TILEPYRAMID_H
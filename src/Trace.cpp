@@ -0,0 +1,122 @@
+#include "Trace.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+std::atomic<bool> recording{false};
+
+namespace {
+
+struct Event {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+};
+
+// Single writer (the owning thread), any reader: the writer publishes the
+// head after filling the slot, readers drop slots that may have been
+// overwritten while they were copying
+struct Ring {
+    static constexpr uint64_t Capacity = 1 << 14;
+    int tid;
+    Event events[Capacity];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> cleared{0};   // events before this index are discarded
+};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Every ring ever created, kept after its thread exits so its events can still be exported
+std::mutex registryMutex;
+std::vector<std::shared_ptr<Ring>> registry;
+
+Ring &localRing()
+{
+    thread_local std::shared_ptr<Ring> ring = []() {
+        auto r = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        r->tid = static_cast<int>(registry.size()) + 1;
+        registry.push_back(r);
+        return r;
+    }();
+    return *ring;
+}
+
+void writeEscaped(std::ofstream &out, const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+    }
+}
+
+} // namespace
+
+void setEnabled(bool enabled)
+{
+    recording.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char *name, int64_t start, int64_t duration)
+{
+    Ring &ring = localRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % Ring::Capacity] = Event{name, start, duration};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool exportJson(const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        rings = registry;
+    }
+
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &ring : rings) {
+        uint64_t end = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(ring->cleared.load(std::memory_order_relaxed),
+                                  end > Ring::Capacity ? end - Ring::Capacity : 0);
+        std::vector<Event> events;
+        for (uint64_t i = begin; i < end; i++)
+            events.push_back(ring->events[i % Ring::Capacity]);
+        // Slots the writer reused during the copy are not trustworthy
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+        uint64_t firstValid = after > Ring::Capacity ? after - Ring::Capacity : 0;
+
+        for (uint64_t i = std::max(begin, firstValid); i < end; i++) {
+            const Event &e = events[i - begin];
+            out << (first ? "" : ",\n") << "{\"name\":\"";
+            writeEscaped(out, e.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << '}';
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto &ring : registry)
+        ring->cleared.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+} // namespace trace
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped timers recorded in per-thread ring buffers, exported as Chrome trace JSON
+// (chrome://tracing, ui.perfetto.dev). Recording is off by default: a disabled scope
+// costs one relaxed atomic load. Writers never lock, each thread owns its buffer.
+//
+//   void MainWindow::applyMask()
+//   {
+//       TRACE_SCOPE("applyMask");
+//       ...
+namespace trace {
+
+extern std::atomic<bool> recording;
+
+inline bool enabled() { return recording.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+
+// Microseconds since the process started
+int64_t now();
+// Name must outlive the export, typically a string literal
+void record(const char *name, int64_t start, int64_t duration);
+
+// Latest events of every thread, oldest ones are overwritten once a buffer is full
+bool exportJson(const std::string &path);
+void clear();
+
+class Scope
+{
+public:
+    explicit Scope(const char *name)
+        : _name(name), _start(enabled() ? now() : -1) {}
+    ~Scope()
+    {
+        if (_start >= 0)
+            record(_name, _start, now() - _start);
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *_name;
+    int64_t _start;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(_traceScope, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,119 @@
+#include "Tracker.h"
+#include <algorithm>
+#include <cmath>
+
+void Tracker::reset()
+{
+    _tracks.clear();
+    _previousTracks.clear();
+    _nextId = _previousNextId = 0;
+    _lastFrame = _previousFrame = -1;
+}
+
+std::vector<int> Tracker::update(int frame, const std::vector<cv::Point2f> &detections)
+{
+    if (frame == _lastFrame && _lastFrame >= 0) {
+        _tracks = _previousTracks;
+        _nextId = _previousNextId;
+        _lastFrame = _previousFrame;
+    }
+    if (_lastFrame >= 0 && (frame <= _lastFrame || frame - _lastFrame > _maxGap)) {
+        // Jumped around the video: nothing to link to
+        _tracks.clear();
+        _lastFrame = -1;
+    }
+    _previousTracks = _tracks;
+    _previousNextId = _nextId;
+    _previousFrame = _lastFrame;
+
+    const int n = static_cast<int>(detections.size());
+    std::vector<int> ids(n, -1);
+
+    // Bucket the detections
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for (int i = 0; i < n; i++) {
+        const cv::Point2f &p = detections[i];
+        if (i == 0) { x0 = x1 = p.x; y0 = y1 = p.y; }
+        x0 = std::min(x0, p.x); x1 = std::max(x1, p.x);
+        y0 = std::min(y0, p.y); y1 = std::max(y1, p.y);
+    }
+    const float cell = _maxDistance;
+    const int cols = n ? static_cast<int>((x1 - x0) / cell) + 1 : 0;
+    const int rows = n ? static_cast<int>((y1 - y0) / cell) + 1 : 0;
+    auto cellOf = [&](const cv::Point2f &p, int &cx, int &cy) {
+        cx = static_cast<int>(std::floor((p.x - x0) / cell));
+        cy = static_cast<int>(std::floor((p.y - y0) / cell));
+    };
+    _cellStart.assign(static_cast<size_t>(cols) * rows + 1, 0);
+    _cellItems.resize(n);
+    for (int i = 0; i < n; i++) {
+        int cx, cy;
+        cellOf(detections[i], cx, cy);
+        _cellStart[cy * cols + cx + 1]++;
+    }
+    for (size_t c = 1; c < _cellStart.size(); c++)
+        _cellStart[c] += _cellStart[c - 1];
+    std::vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+    for (int i = 0; i < n; i++) {
+        int cx, cy;
+        cellOf(detections[i], cx, cy);
+        _cellItems[fill[cy * cols + cx]++] = i;
+    }
+
+    // Candidate pairs within the gate, around each track's predicted position
+    struct Pair { float d2; int track; int detection; };
+    std::vector<Pair> pairs;
+    const float gate2 = _maxDistance * _maxDistance;
+    for (int t = 0; t < static_cast<int>(_tracks.size()); t++) {
+        const std::vector<cv::Point2f> &trail = _tracks[t].trail;
+        cv::Point2f predicted = trail.back();
+        if (trail.size() >= 2 && _tracks[t].missed == 0)
+            predicted += trail.back() - trail[trail.size() - 2];   // constant velocity
+        int cx, cy;
+        cellOf(predicted, cx, cy);
+        for (int gy = std::max(0, cy - 1); gy <= std::min(rows - 1, cy + 1); gy++)
+            for (int gx = std::max(0, cx - 1); gx <= std::min(cols - 1, cx + 1); gx++) {
+                int c = gy * cols + gx;
+                for (int k = _cellStart[c]; k < _cellStart[c + 1]; k++) {
+                    int i = _cellItems[k];
+                    cv::Point2f d = detections[i] - predicted;
+                    float d2 = d.x * d.x + d.y * d.y;
+                    if (d2 < gate2)
+                        pairs.push_back({d2, t, i});
+                }
+            }
+    }
+
+    // Greedy assignment, closest pairs first
+    std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) { return a.d2 < b.d2; });
+    std::vector<char> trackTaken(_tracks.size(), 0);
+    for (const Pair &p : pairs) {
+        if (trackTaken[p.track] || ids[p.detection] >= 0) continue;
+        trackTaken[p.track] = 1;
+        Track &track = _tracks[p.track];
+        ids[p.detection] = track.id;
+        track.trail.push_back(detections[p.detection]);
+        if (static_cast<int>(track.trail.size()) > _trailLength)
+            track.trail.erase(track.trail.begin());
+        track.lastFrame = frame;
+        track.missed = 0;
+    }
+
+    // Lost tracks age, then go
+    for (size_t t = 0; t < _tracks.size(); t++)
+        if (!trackTaken[t])
+            _tracks[t].missed++;
+    _tracks.erase(std::remove_if(_tracks.begin(), _tracks.end(),
+                                 [this](const Track &t) { return t.missed > _maxMissed; }),
+                  _tracks.end());
+
+    // Unmatched detections start new tracks
+    for (int i = 0; i < n; i++) {
+        if (ids[i] >= 0) continue;
+        ids[i] = _nextId;
+        _tracks.push_back(Track{_nextId++, {detections[i]}, frame, 0});
+    }
+
+    _lastFrame = frame;
+    return ids;
+}
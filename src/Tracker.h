@@ -0,0 +1,51 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <vector>
+
+// Frame to frame association of detections, a preview of what tracking will do with
+// the current detection parameters. Detections are bucketed in a uniform grid whose cells
+// are the gating distance, so each track only looks at the 3x3 cells around its predicted
+// position, and pairs are assigned greedily, closest first.
+class Tracker
+{
+public:
+    struct Track {
+        int id;
+        std::vector<cv::Point2f> trail;   // oldest first, the last point is the current position
+        int lastFrame;
+        int missed = 0;                   // consecutive frames without a detection
+    };
+
+    // Farthest a robot moves between two frames, in pixels
+    void setMaxDistance(float distance) { _maxDistance = std::max(1.0f, distance); }
+    void setTrailLength(int length) { _trailLength = std::max(2, length); }
+    void reset();
+
+    // Links the detections of a frame to the tracks. A frame that does not follow the
+    // previous one starts over, the same frame again replaces its previous update.
+    // Returns the track id of every detection.
+    std::vector<int> update(int frame, const std::vector<cv::Point2f> &detections);
+    const std::vector<Track> &tracks() const { return _tracks; }
+
+private:
+    float _maxDistance = 60;
+    int _trailLength = 64;
+    int _maxMissed = 5;
+    int _maxGap = 3;                      // frames skipped before the tracks are dropped
+    int _nextId = 0;
+    int _lastFrame = -1;
+    std::vector<Track> _tracks;
+    // State before the last update, to redo it when the same frame comes again
+    std::vector<Track> _previousTracks;
+    int _previousNextId = 0;
+    int _previousFrame = -1;
+
+    // Uniform grid over the detections, CSR layout rebuilt every frame
+    std::vector<int> _cellStart;
+    std::vector<int> _cellItems;
+};
+
+#endif // TRACKER_H
@@ -0,0 +1,153 @@
+#include "VideoSource.h"
+#include <QMetaObject>
+#include <QPointer>
+#include <algorithm>
+
+VideoSource::VideoSource(QObject *parent)
+    : QObject(parent)
+{
+}
+
+VideoSource::~VideoSource()
+{
+    close();
+}
+
+bool VideoSource::open(const QString &path)
+{
+    close();
+    if (!_capture.open(path.toStdString()))
+        return false;
+
+    _frameCount = static_cast<int>(_capture.get(cv::CAP_PROP_FRAME_COUNT));
+    _fps = _capture.get(cv::CAP_PROP_FPS);
+    _playhead = 0;
+    _delivered = false;
+    _decodePos = 0;
+    _stop = false;
+    _thread = std::thread(&VideoSource::_run, this);
+    return true;
+}
+
+void VideoSource::close()
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        _thread.join();
+    }
+    _capture.release();
+    _frames.clear();
+    _frameCount = 0;
+}
+
+void VideoSource::requestFrame(int index)
+{
+    if (!isOpen()) return;
+    index = std::clamp(index, 0, std::max(0, _frameCount - 1));
+
+    cv::Mat cached;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _playhead = index;
+        _delivered = false;
+        auto it = _frames.find(index);
+        if (it != _frames.end()) {
+            cached = it->second;
+            _delivered = true;
+        }
+    }
+    _wake.notify_all();
+    if (!cached.empty())
+        emit frameReady(index, cached);
+}
+
+int VideoSource::_nextToDecode() const
+{
+    // The playhead first, then forward, then the frames just behind it
+    if (!_frames.count(_playhead))
+        return _playhead;
+    for (int i = _playhead + 1; i <= std::min(_playhead + Ahead, _frameCount - 1); i++)
+        if (!_frames.count(i)) return i;
+    for (int i = _playhead - 1; i >= std::max(0, _playhead - Behind); i--)
+        if (!_frames.count(i)) return i;
+    return -1;
+}
+
+void VideoSource::_deliver(int index, const cv::Mat &frame)
+{
+    QPointer<VideoSource> self(this);
+    QMetaObject::invokeMethod(this, [self, index, frame]() {
+        if (self && index == self->_playhead)
+            emit self->frameReady(index, frame);
+    }, Qt::QueuedConnection);
+}
+
+void VideoSource::_run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        int target = _nextToDecode();
+        if (target < 0) {
+            _wake.wait(lock);
+            continue;
+        }
+        const int playhead = _playhead;
+        lock.unlock();
+
+        // Decode forward when close enough, otherwise seek
+        if (target < _decodePos || target - _decodePos > SeekThreshold) {
+            // Filling the frames behind the playhead: one sweep from the start of the window
+            int start = (target < _decodePos && target != playhead) ? std::max(0, playhead - Behind) : target;
+            _capture.set(cv::CAP_PROP_POS_FRAMES, start);
+            _decodePos = start;
+        }
+
+        bool failed = false;
+        while (_decodePos <= target) {
+            cv::Mat frame;
+            if (!_capture.read(frame) || frame.empty()) {
+                failed = true;
+                break;
+            }
+            int index = _decodePos++;
+
+            std::lock_guard<std::mutex> guard(_mutex);
+            if (index >= _playhead - Behind && index <= _playhead + Ahead)
+                _frames[index] = frame;
+            if (index == _playhead && !_delivered) {
+                _delivered = true;
+                _deliver(index, frame);
+            }
+            // The user moved on: plan again from the new playhead
+            if (_stop || _playhead != playhead) break;
+        }
+
+        lock.lock();
+        if (failed) {
+            // Past the real end of the stream (frame counts are estimates), stop there
+            if (_decodePos < _frameCount) {
+                const int count = _decodePos;
+                _frameCount = count;
+                QPointer<VideoSource> self(this);
+                QMetaObject::invokeMethod(this, [self, count]() {
+                    // Dropped if the video was replaced meanwhile
+                    if (self && count == self->_frameCount)
+                        emit self->frameCountChanged(count);
+                }, Qt::QueuedConnection);
+            }
+            _frames[target] = cv::Mat();
+        }
+
+        // Forget the frames that left the window
+        for (auto it = _frames.begin(); it != _frames.end();) {
+            if (it->first < _playhead - Behind || it->first > _playhead + Ahead)
+                it = _frames.erase(it);
+            else
+                ++it;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef VIDEOSOURCE_H
+#define VIDEOSOURCE_H
+
+#include <QObject>
+#include <QString>
+#include <opencv2/videoio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Video file decoded on a background thread into a cache of frames around the playhead.
+// Frames ahead of the playhead are decoded sequentially; the decoder only seeks (to the
+// previous keyframe, through the backend) when the playhead jumps backwards or far ahead.
+class VideoSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit VideoSource(QObject *parent = nullptr);
+    ~VideoSource();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return _thread.joinable(); }
+    int frameCount() const { return _frameCount; }
+    double fps() const { return _fps; }
+
+    // Moves the playhead, frameReady is emitted once the frame is decoded
+    void requestFrame(int index);
+
+signals:
+    // Only emitted for the latest requested frame
+    void frameReady(int index, const cv::Mat &frame);
+    // The decoder reached the real end of the stream before the estimated frame count
+    void frameCountChanged(int count);
+
+private:
+    static constexpr int Ahead = 24;          // frames prefetched after the playhead
+    static constexpr int Behind = 8;          // frames kept before the playhead
+    static constexpr int SeekThreshold = 48;  // decoding forward is cheaper than seeking up to here
+
+    cv::VideoCapture _capture;
+    std::atomic<int> _frameCount{0};  // lowered by the decoder thread at the end of the stream
+    double _fps = 0;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stop = false;
+    int _playhead = 0;
+    bool _delivered = false;          // playhead frame already posted
+    std::map<int, cv::Mat> _frames;   // decoded frames in the window around the playhead
+    int _decodePos = 0;               // next frame the decoder will return, decoder thread only
+
+    void _run();
+    int _nextToDecode() const;
+    void _deliver(int index, const cv::Mat &frame);
+};
+
+#endif // VIDEOSOURCE_H
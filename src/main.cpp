@@ -1,13 +1,45 @@
 #include <QApplication>
+#include <cstdio>
+#include <cstring>
 #include "MainWindow.h"
+#include "Batch.h"
+#include "Trace.h"
 
 int main(int argc, char *argv[])
 {
+    // Headless batch processing, no window
+    if (argc > 1 && std::strcmp(argv[1], "--batch") == 0)
+        return runBatch(argc, argv);
+
+    // --trace <file>: record from startup, written as Chrome trace JSON on exit
+    const char *tracePath = nullptr;
+    for (int i = 1; i + 1 < argc; i++)
+        if (std::strcmp(argv[i], "--trace") == 0)
+            tracePath = argv[i + 1];
+    if (tracePath)
+        trace::setEnabled(true);
+
     QApplication app(argc, argv);
 
     MainWindow window;
     window.resize(1000, 600);
     window.show();
 
-    return app.exec();
+    // pogotrack_gui [image]: the window comes up while the image loads
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "--trace") {
+            i++;
+            continue;
+        }
+        if (!args[i].startsWith("-")) {
+            window.openImage(args[i]);
+            break;
+        }
+    }
+
+    int status = app.exec();
+    if (tracePath && !trace::exportJson(tracePath))
+        std::fprintf(stderr, "Could not write trace to %s\n", tracePath);
+    return status;
 }